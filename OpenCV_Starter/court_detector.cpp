@@ -0,0 +1,643 @@
+#include "court_detector.h"
+
+#include <algorithm>                       // std::sort
+#include <cfloat>                          // FLT_MAX
+#include <cmath>                           // std::atan2
+#include <opencv2/imgproc/imgproc.hpp>     // cv::Canny(), cv::HoughLinesP()
+
+using namespace std;
+using namespace cv;
+
+#define FLOOR_TOLERANCE 40        // per channel, from the floor colour
+#define FLOOR_OFFSET 3.f          // search pixels out from a segment its two sides are sampled at
+#define FLOOR_INNER 0.6           // a floor edge has floor on this much of one side ...
+#define FLOOR_OUTER 0.3           // ... and on at most this much of the other
+#define MERGE_ANGLE 0.035f        // segments this many radians apart ...
+#define MERGE_DISTANCE 3.f        // ... and this close in search pixels are one line
+#define MIN_FAMILY_ANGLE 0.35f    // the two side directions must differ by at least this many radians
+#define MIN_AREA_FRACTION 0.02    // of the frame, smaller candidate quads are ignored
+#define SIDE_ANGLE_COS 0.94f      // a line pixel's gradient is within 20 degrees of the side normal
+#define MIN_SIDE_WEIGHT 2000.f    // summed gradient of a refit side, fewer means the side is lost
+
+CourtDetectorParams::CourtDetectorParams()
+	: detectWidth(480), houghVotes(30), minLineLength(0.05), maxLineGap(6),
+	linesPerFamily(8), refineRadius(12), trackRadius(24), minGradient(80), track(true)
+{
+}
+
+CourtDetectorStats::CourtDetectorStats()
+	: frames(0), tracked(0), searches(0), losses(0), misses(0)
+{
+}
+
+// A line n.p = rho, n of unit length
+struct CourtLine
+{
+	Point2f n;
+	float rho;
+	float weight; // summed length of its segments
+};
+
+static bool HeavierLine(const CourtLine& a, const CourtLine& b)
+{
+	return a.weight > b.weight;
+}
+
+static CourtLine LineThrough(Point2f a, Point2f b)
+{
+	Point2f d = b - a;
+	float len = (float)norm(d);
+	CourtLine line;
+	line.n = Point2f(-d.y / len, d.x / len);
+	line.rho = line.n.dot(a);
+	line.weight = len;
+	return line;
+}
+
+static bool Intersect(const CourtLine& a, const CourtLine& b, Point2f& p)
+{
+	float det = a.n.x * b.n.y - a.n.y * b.n.x;
+	if (std::abs(det) < 1e-6f)
+	{
+		return false;
+	}
+	p = Point2f((a.rho * b.n.y - b.rho * a.n.y) / det, (a.n.x * b.rho - b.n.x * a.rho) / det);
+	return true;
+}
+
+// Twice the signed area, positive when the corners go clockwise on screen
+static float QuadArea(const Point2f c[4])
+{
+	float area = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		const Point2f& a = c[i];
+		const Point2f& b = c[(i + 1) & 3];
+		area += a.x * b.y - b.x * a.y;
+	}
+	return area;
+}
+
+static bool IsConvex(const Point2f c[4])
+{
+	int sign = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		Point2f e0 = c[(i + 1) & 3] - c[i];
+		Point2f e1 = c[(i + 2) & 3] - c[(i + 1) & 3];
+		float cross = e0.cross(e1);
+		int s = cross > 0 ? 1 : cross < 0 ? -1 : 0;
+		if (!s || (sign && s != sign))
+		{
+			return false;
+		}
+		sign = s;
+	}
+	return true;
+}
+
+// Clockwise on screen, the leftmost corner first
+static void OrderCorners(Point2f c[4])
+{
+	if (QuadArea(c) < 0)
+	{
+		swap(c[1], c[3]);
+	}
+	int first = 0;
+	for (int i = 1; i < 4; ++i)
+	{
+		if (c[i].x < c[first].x)
+		{
+			first = i;
+		}
+	}
+	rotate(c, c + first, c + 4);
+}
+
+// Colours within FLOOR_TOLERANCE of the floor colour: the most common
+// colour, at 4 bits per channel, of the middle quarter of the frame, where
+// the court is in any usable view. A mode rather than a median, painted areas
+// like the keys take up a good part of the middle too.
+static void FloorRange(const Mat& img, Scalar& lo, Scalar& hi)
+{
+	int cn = img.channels();
+	Rect center(img.cols / 4, img.rows / 4, img.cols / 2, img.rows / 2);
+	vector<int> hist(1 << (4 * cn));
+	for (int y = center.y; y < center.br().y; ++y)
+	{
+		const uchar* p = img.ptr<uchar>(y) + center.x * cn;
+		for (int x = 0; x < center.width; ++x, p += cn)
+		{
+			int bin = 0;
+			for (int c = 0; c < cn; ++c)
+			{
+				bin = (bin << 4) | (p[c] >> 4);
+			}
+			++hist[bin];
+		}
+	}
+	int mode = (int)(max_element(hist.begin(), hist.end()) - hist.begin());
+
+	for (int c = 0; c < cn; ++c)
+	{
+		int level = (((mode >> (4 * (cn - 1 - c))) & 15) << 4) + 8;
+		lo[c] = level - FLOOR_TOLERANCE;
+		hi[c] = level + FLOOR_TOLERANCE;
+	}
+}
+
+// True when floor covers one side of the segment and not the other,
+// sampled FLOOR_OFFSET pixels out on both sides
+static bool IsFloorEdge(const Mat& floor, const Vec4i& s)
+{
+	Point2f a((float)s[0], (float)s[1]), b((float)s[2], (float)s[3]);
+	Point2f d = b - a;
+	int steps = max(cvCeil(norm(d) / 2), 1);
+	d *= 1.f / steps;
+	Point2f n = Point2f(-d.y, d.x) * (float)(FLOOR_OFFSET / norm(d));
+
+	Rect frameRect(0, 0, floor.cols, floor.rows);
+	int side[2] = { 0, 0 }, samples = 0;
+	Point2f p = a;
+	for (int i = 0; i <= steps; ++i, p += d)
+	{
+		Point p0(cvRound(p.x + n.x), cvRound(p.y + n.y));
+		Point p1(cvRound(p.x - n.x), cvRound(p.y - n.y));
+		if (frameRect.contains(p0) && frameRect.contains(p1))
+		{
+			side[0] += floor.at<uchar>(p0) != 0;
+			side[1] += floor.at<uchar>(p1) != 0;
+			++samples;
+		}
+	}
+	int inner = max(side[0], side[1]), outer = min(side[0], side[1]);
+	return samples && inner >= FLOOR_INNER * samples && outer <= FLOOR_OUTER * samples;
+}
+
+// Merges HoughLinesP segments lying on the same line, heaviest first. Only
+// segments with floor on one side are kept, which drops the outline of thin
+// shadows and markings crossing the floor.
+static void MergeSegments(const vector<Vec4i>& segments, const Mat& floor, vector<CourtLine>& lines)
+{
+	vector<pair<float, int> > order;
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		const Vec4i& s = segments[i];
+		if (IsFloorEdge(floor, s))
+		{
+			order.push_back(make_pair(-(float)norm(Point(s[2] - s[0], s[3] - s[1])), (int)i));
+		}
+	}
+	sort(order.begin(), order.end());
+
+	lines.clear();
+	float cosMerge = std::cos(MERGE_ANGLE);
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const Vec4i& s = segments[order[i].second];
+		Point2f a((float)s[0], (float)s[1]), b((float)s[2], (float)s[3]);
+		CourtLine piece = LineThrough(a, b);
+		Point2f mid = (a + b) * 0.5f;
+		size_t j = 0;
+		for (; j < lines.size(); ++j)
+		{
+			if (std::abs(lines[j].n.dot(piece.n)) >= cosMerge && std::abs(lines[j].n.dot(mid) - lines[j].rho) <= MERGE_DISTANCE)
+			{
+				lines[j].weight += piece.weight;
+				break;
+			}
+		}
+		if (j == lines.size())
+		{
+			lines.push_back(piece);
+		}
+	}
+	sort(lines.begin(), lines.end(), HeavierLine);
+}
+
+// Splits lines by direction into the two families of court sides with a
+// weighted 2-means on doubled angles, so opposite normals count as one
+// direction. Each family keeps its count heaviest lines.
+static bool SplitFamilies(const vector<CourtLine>& lines, int count, vector<CourtLine> family[2])
+{
+	if (lines.size() < 4)
+	{
+		return false;
+	}
+
+	vector<Point2f> u(lines.size());
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		const Point2f& n = lines[i].n;
+		u[i] = Point2f(n.x * n.x - n.y * n.y, 2 * n.x * n.y);
+	}
+
+	// the heaviest line and the one most unlike it seed the two families
+	Point2f center[2] = { u[0], u[0] };
+	for (size_t i = 1; i < u.size(); ++i)
+	{
+		if (u[i].dot(u[0]) < center[1].dot(u[0]))
+		{
+			center[1] = u[i];
+		}
+	}
+
+	vector<int> label(lines.size());
+	for (int it = 0; it < 5; ++it)
+	{
+		Point2f sum[2];
+		for (size_t i = 0; i < u.size(); ++i)
+		{
+			label[i] = u[i].dot(center[1]) > u[i].dot(center[0]);
+			sum[label[i]] += u[i] * lines[i].weight;
+		}
+		for (int k = 0; k < 2; ++k)
+		{
+			float len = (float)norm(sum[k]);
+			if (len > 0)
+			{
+				center[k] = sum[k] * (1.f / len);
+			}
+		}
+	}
+
+	// doubled angles, so the centers are 2 * MIN_FAMILY_ANGLE apart at least
+	if (center[0].dot(center[1]) > std::cos(2 * MIN_FAMILY_ANGLE))
+	{
+		return false;
+	}
+
+	for (int k = 0; k < 2; ++k)
+	{
+		family[k].clear();
+	}
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		if ((int)family[label[i]].size() < count)
+		{
+			family[label[i]].push_back(lines[i]);
+		}
+	}
+	return family[0].size() >= 2 && family[1].size() >= 2;
+}
+
+// Pixels of the segment a -> b on support minus pixels off it
+static int SideSupport(const Mat& support, Point2f a, Point2f b)
+{
+	Point2f d = b - a;
+	int steps = cvCeil(max(std::abs(d.x), std::abs(d.y)));
+	if (steps == 0)
+	{
+		return 0;
+	}
+	d *= 1.f / steps;
+
+	int score = 0;
+	Point2f p = a;
+	for (int i = 0; i <= steps; ++i, p += d)
+	{
+		score += support.at<uchar>(cvRound(p.y), cvRound(p.x)) ? 1 : -1;
+	}
+	return score;
+}
+
+// Floor pixels inside the convex quad c minus the other pixels inside it,
+// from per row prefix sums of the floor mask
+static int FloorFit(const Mat& floorSums, const Point2f c[4])
+{
+	float top = min(min(c[0].y, c[1].y), min(c[2].y, c[3].y));
+	float bottom = max(max(c[0].y, c[1].y), max(c[2].y, c[3].y));
+	int fit = 0;
+	for (int y = max(cvCeil(top), 0); y <= min(cvFloor(bottom), floorSums.rows - 1); ++y)
+	{
+		// the row crosses the outline of a convex quad in one span
+		float xs = FLT_MAX, xe = -FLT_MAX;
+		for (int i = 0; i < 4; ++i)
+		{
+			const Point2f& a = c[i];
+			const Point2f& b = c[(i + 1) & 3];
+			if ((a.y <= y && y <= b.y) || (b.y <= y && y <= a.y))
+			{
+				float x = a.y == b.y ? a.x : a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+				xs = min(xs, min(x, a.y == b.y ? b.x : x));
+				xe = max(xe, max(x, a.y == b.y ? b.x : x));
+			}
+		}
+		int x0 = max(cvCeil(xs), 0), x1 = min(cvFloor(xe), floorSums.cols - 2);
+		if (x1 >= x0)
+		{
+			const int* sum = floorSums.ptr<int>(y);
+			fit += 2 * (sum[x1 + 1] - sum[x0]) - (x1 - x0 + 1);
+		}
+	}
+	return fit;
+}
+
+CourtDetector::CourtDetector(const CourtDetectorParams& params)
+	: params(params), tracking(false)
+{
+}
+
+bool CourtDetector::Detect(const Mat& frame, Point2f corners[4])
+{
+	CV_Assert(frame.type() == CV_8UC3 || frame.type() == CV_8UC4);
+	++stats.frames;
+
+	if (params.track && tracking)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			corners[i] = last[i];
+		}
+		if (Refine(frame, corners, params.trackRadius))
+		{
+			++stats.tracked;
+			for (int i = 0; i < 4; ++i)
+			{
+				last[i] = corners[i];
+			}
+			return true;
+		}
+		++stats.losses;
+	}
+
+	++stats.searches;
+	tracking = Search(frame, corners);
+	if (!tracking)
+	{
+		++stats.misses;
+		return false;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		last[i] = corners[i];
+	}
+	return true;
+}
+
+bool CourtDetector::Search(const Mat& frame, Point2f corners[4])
+{
+	double scale = min(1., (double)params.detectWidth / frame.cols);
+	if (scale < 1)
+	{
+		resize(frame, small, Size(cvRound(frame.cols * scale), cvRound(frame.rows * scale)), 0, 0, INTER_AREA);
+	}
+	else
+	{
+		small = frame;
+	}
+
+	// the court sides are where the floor ends, so the lines are searched on
+	// the outline of the floor rather than on the frame: the stands, boards
+	// and lines painted on the floor leave no edges there. The mask is binary,
+	// any thresholds do.
+	FloorRange(small, floorLo, floorHi);
+	inRange(small, floorLo, floorHi, floorMask);
+	Canny(floorMask, edges, 100, 200);
+	HoughLinesP(edges, segments, 1, CV_PI / 180, params.houghVotes, params.minLineLength * small.cols, params.maxLineGap);
+
+	vector<CourtLine> lines, family[2];
+	MergeSegments(segments, floorMask, lines);
+	if (!SplitFamilies(lines, params.linesPerFamily, family))
+	{
+		return false;
+	}
+
+	// a side within a pixel of an edge counts as on it
+	dilate(edges, support, Mat());
+
+	// floor pixels left of every column, per row
+	floorSums.create(floorMask.rows, floorMask.cols + 1, CV_32S);
+	for (int y = 0; y < floorMask.rows; ++y)
+	{
+		const uchar* m = floorMask.ptr<uchar>(y);
+		int* sum = floorSums.ptr<int>(y);
+		sum[0] = 0;
+		for (int x = 0; x < floorMask.cols; ++x)
+		{
+			sum[x + 1] = sum[x] + (m[x] != 0);
+		}
+	}
+
+	Rect frameRect(0, 0, small.cols, small.rows);
+	float minArea = (float)(2 * MIN_AREA_FRACTION * small.total());
+	int best = 0;
+	const vector<CourtLine>& a = family[0];
+	const vector<CourtLine>& b = family[1];
+	for (size_t a0 = 0; a0 < a.size(); ++a0)
+	for (size_t a1 = a0 + 1; a1 < a.size(); ++a1)
+	for (size_t b0 = 0; b0 < b.size(); ++b0)
+	for (size_t b1 = b0 + 1; b1 < b.size(); ++b1)
+	{
+		// sides a0, b0, a1, b1 in turn
+		Point2f c[4];
+		if (!Intersect(a[a0], b[b0], c[0]) || !Intersect(b[b0], a[a1], c[1]) ||
+			!Intersect(a[a1], b[b1], c[2]) || !Intersect(b[b1], a[a0], c[3]))
+		{
+			continue;
+		}
+		bool inside = true;
+		for (int i = 0; i < 4; ++i)
+		{
+			inside &= frameRect.contains(Point(cvRound(c[i].x), cvRound(c[i].y)));
+		}
+		if (!inside || !IsConvex(c) || std::abs(QuadArea(c)) < minArea)
+		{
+			continue;
+		}
+
+		// mostly the fit to the floor, which picks the whole court over parts
+		// of it, the outline decides between lines a pixel or two apart
+		int score = FloorFit(floorSums, c);
+		if (score <= 0)
+		{
+			continue;
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			score += SideSupport(support, c[i], c[(i + 1) & 3]);
+		}
+		if (score > best)
+		{
+			best = score;
+			for (int i = 0; i < 4; ++i)
+			{
+				corners[i] = c[i] * (float)(1. / scale);
+			}
+		}
+	}
+	if (best == 0)
+	{
+		return false;
+	}
+	OrderCorners(corners);
+
+	// the search corners are off by up to a couple of downscaled pixels,
+	// when the refinement fails they are still the best there is
+	Point2f coarse[4] = { corners[0], corners[1], corners[2], corners[3] };
+	if (!Refine(frame, corners, params.refineRadius + cvCeil(2 / scale)))
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			corners[i] = coarse[i];
+		}
+	}
+	return true;
+}
+
+bool CourtDetector::Refine(const Mat& frame, Point2f corners[4], int radius)
+{
+	// gradients and floor of a window around every corner, one pixel larger
+	// for Sobel
+	Rect frameRect(0, 0, frame.cols, frame.rows);
+	Rect windows[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		windows[i] = Rect(cvFloor(corners[i].x) - radius - 1, cvFloor(corners[i].y) - radius - 1, 2 * radius + 3, 2 * radius + 3) & frameRect;
+		if (windows[i].width < 3 || windows[i].height < 3)
+		{
+			return false;
+		}
+		cvtColor(frame(windows[i]), window, frame.channels() == 4 ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+		Sobel(window, gradX[i], CV_16S, 1, 0);
+		Sobel(window, gradY[i], CV_16S, 0, 1);
+		inRange(frame(windows[i]), floorLo, floorHi, windowFloor[i]);
+	}
+
+	// half width of the band a side is fit in, also how far in and out of a
+	// pixel the floor is probed
+	int band = max(3, radius / 5);
+
+	CourtLine sides[4];
+	for (int s = 0; s < 4; ++s)
+	{
+		CourtLine line = LineThrough(corners[s], corners[(s + 1) & 3]);
+
+		// strong gradient pixels across the side in both corner windows with
+		// floor on the inside and none on the outside, the sides are the
+		// outline of the floor just like in the search. The corners go
+		// clockwise, so n points into the court.
+		Point probe(cvRound(line.n.x * band), cvRound(line.n.y * band));
+		linePixels.clear();
+		for (int k = 0; k < 2; ++k)
+		{
+			int w = (s + k) & 3;
+			Rect floorRect(0, 0, windows[w].width, windows[w].height);
+			for (int y = 1; y < windows[w].height - 1; ++y)
+			{
+				const short* dx = gradX[w].ptr<short>(y);
+				const short* dy = gradY[w].ptr<short>(y);
+				for (int x = 1; x < windows[w].width - 1; ++x)
+				{
+					int mag = std::abs(dx[x]) + std::abs(dy[x]);
+					if (mag < params.minGradient)
+					{
+						continue;
+					}
+					Point2f p((float)(windows[w].x + x), (float)(windows[w].y + y));
+					float g = line.n.x * dx[x] + line.n.y * dy[x];
+					if (std::abs(line.n.dot(p) - line.rho) > radius || g * g < SIDE_ANGLE_COS * SIDE_ANGLE_COS * (dx[x] * dx[x] + dy[x] * dy[x]))
+					{
+						continue;
+					}
+					Point in = Point(x, y) + probe, out = Point(x, y) - probe;
+					if (floorRect.contains(in) && floorRect.contains(out) && windowFloor[w].at<uchar>(in) && !windowFloor[w].at<uchar>(out))
+					{
+						linePixels.push_back(Point3f(p.x, p.y, (float)mag));
+					}
+				}
+			}
+		}
+
+		// the side moved to the offset with the most gradient within band,
+		// floor coloured clutter parallel to it counts less the further it is
+		// from where the side was
+		offsets.assign(2 * radius + 1, 0.f);
+		for (size_t i = 0; i < linePixels.size(); ++i)
+		{
+			float d = line.n.x * linePixels[i].x + line.n.y * linePixels[i].y - line.rho;
+			offsets[min(cvRound(d) + radius, 2 * radius)] += linePixels[i].z * (1 - 0.5f * std::abs(d) / radius);
+		}
+		float bestSum = 0;
+		int shift = 0;
+		for (int o = -radius; o <= radius; ++o)
+		{
+			float sum = 0;
+			for (int j = max(o - band, -radius); j <= min(o + band, radius); ++j)
+			{
+				sum += offsets[j + radius];
+			}
+			if (sum > bestSum)
+			{
+				bestSum = sum;
+				shift = o;
+			}
+		}
+		line.rho += shift;
+
+		// weighted total least squares over the band, twice: the second pass
+		// centers the band on the fitted line
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+			for (size_t i = 0; i < linePixels.size(); ++i)
+			{
+				const Point3f& p = linePixels[i];
+				if (std::abs(line.n.x * p.x + line.n.y * p.y - line.rho) <= band)
+				{
+					sw += p.z;
+					sx += p.z * p.x;
+					sy += p.z * p.y;
+					sxx += p.z * p.x * p.x;
+					sxy += p.z * p.x * p.y;
+					syy += p.z * p.y * p.y;
+				}
+			}
+			if (sw < MIN_SIDE_WEIGHT)
+			{
+				return false;
+			}
+
+			double mx = sx / sw, my = sy / sw;
+			double cxx = sxx / sw - mx * mx, cxy = sxy / sw - mx * my, cyy = syy / sw - my * my;
+			double angle = 0.5 * std::atan2(2 * cxy, cxx - cyy);
+			Point2f n((float)-std::sin(angle), (float)std::cos(angle));
+			if (n.dot(line.n) < 0)
+			{
+				n = -n;
+			}
+			line.n = n;
+			line.rho = (float)(n.x * mx + n.y * my);
+		}
+		sides[s] = line;
+	}
+
+	// corner s lies on sides s - 1 and s
+	Point2f refined[4];
+	for (int s = 0; s < 4; ++s)
+	{
+		if (!Intersect(sides[(s + 3) & 3], sides[s], refined[s]) || norm(refined[s] - corners[s]) > radius)
+		{
+			return false;
+		}
+	}
+	if (!IsConvex(refined))
+	{
+		return false;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		corners[i] = refined[i];
+	}
+	return true;
+}
+
+void CourtDetector::Reset()
+{
+	tracking = false;
+}
+
+CourtDetectorStats CourtDetector::GetStats() const
+{
+	return stats;
+}
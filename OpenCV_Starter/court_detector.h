@@ -0,0 +1,96 @@
+#ifndef COURT_DETECTOR_H
+#define COURT_DETECTOR_H
+
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+// Settings of CourtDetector, distances are in full resolution pixels unless
+// noted otherwise
+struct CourtDetectorParams
+{
+	int detectWidth;      // frames are downscaled to at most this width for the full search
+	int houghVotes;       // HoughLinesP accumulator threshold
+	double minLineLength; // of a HoughLinesP segment, as a fraction of the downscaled width
+	int maxLineGap;       // HoughLinesP gap bridged within a segment, in downscaled pixels
+	int linesPerFamily;   // strongest lines of each direction tried as court sides
+	int refineRadius;     // half size of the corner windows refined after a full search
+	int trackRadius;      // how far a corner may move between two tracked frames
+	int minGradient;      // |dx| + |dy| of the 3x3 Sobel a line pixel needs in the corner windows
+	bool track;           // start from the corners of the previous frame
+
+	CourtDetectorParams();
+};
+
+// Counters of a CourtDetector
+struct CourtDetectorStats
+{
+	int64 frames;   // Detect calls
+	int64 tracked;  // frames found from the previous corners alone
+	int64 searches; // full frame searches, first frames and losses
+	int64 losses;   // tracked frames that had to fall back to a search
+	int64 misses;   // frames without a court
+
+	CourtDetectorStats();
+};
+
+// Finds the four corners of the court in a frame, for ProcessImg.
+//
+// A full search runs on a frame downscaled to detectWidth. The floor is the
+// most common colour in the middle of the frame; Canny and HoughLinesP on
+// the floor mask give the segments of its outline, which are merged into
+// lines and split into the two dominant directions of the court sides.
+// Every pair of lines of one direction with every pair of the other makes a
+// candidate quad, scored by the floor pixels inside it minus the others and
+// by how much of its outline lies on edges. So the court needs a floor of
+// one colour; keys painted in another colour are fine.
+// The corners are then refined at full resolution in small windows around
+// them: each side is refit through the strong gradient pixels with floor on
+// its inner side only, and the corners are the intersections of the sides.
+//
+// In tracking mode the next frame skips the search and only refines the
+// previous corners, in trackRadius windows, so a frame costs four small
+// windows instead of a full frame. The search runs again only when tracking
+// loses the court (too few line pixels, a corner leaving its window or the
+// quad no longer convex).
+// Not thread safe, use one per video.
+class CourtDetector
+{
+public:
+	explicit CourtDetector(const CourtDetectorParams& params = CourtDetectorParams());
+
+	// Finds the court in frame (BGR or BGRA, 8-bit) and sets corners
+	// in the gDistortPts order: clockwise on screen, starting from the
+	// leftmost corner (left bottom, left top, right top, right bottom for a
+	// court seen from its side). Returns false when there is no court.
+	bool Detect(const cv::Mat& frame, cv::Point2f corners[4]);
+
+	// Forgets the tracked corners, the next Detect searches the whole frame
+	void Reset();
+
+	CourtDetectorStats GetStats() const;
+
+private:
+	bool Search(const cv::Mat& frame, cv::Point2f corners[4]);
+	bool Refine(const cv::Mat& frame, cv::Point2f corners[4], int radius);
+
+	CourtDetectorParams params;
+	bool tracking;
+	cv::Point2f last[4];             // corners of the previous frame
+	cv::Mat small;                   // search buffers, reused between frames
+	cv::Scalar floorLo;              // floor colour range of the last search
+	cv::Scalar floorHi;
+	cv::Mat floorMask;
+	cv::Mat edges;
+	cv::Mat support;
+	cv::Mat floorSums;
+	std::vector<cv::Vec4i> segments;
+	cv::Mat window;                  // refine buffers
+	cv::Mat gradX[4];
+	cv::Mat gradY[4];
+	cv::Mat windowFloor[4];
+	std::vector<cv::Point3f> linePixels; // x, y and gradient of the pixels a side is fit to
+	std::vector<float> offsets;          // their gradient by distance from the side
+	CourtDetectorStats stats;
+};
+
+#endif
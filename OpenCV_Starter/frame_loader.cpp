@@ -0,0 +1,150 @@
+#include "frame_loader.h"
+
+#include <cstdio>                          // fopen(), fread()
+#include <opencv2/imgcodecs/imgcodecs.hpp> // cv::imdecode()
+
+using namespace std;
+using namespace cv;
+
+FrameLoaderParams::FrameLoaderParams()
+	: depth(8), threads(2), flags(IMREAD_COLOR)
+{
+}
+
+FrameLoaderStats::FrameLoaderStats()
+	: frames(0), failures(0), decodeTicks(0), decodeStalls(0), consumerStalls(0)
+{
+}
+
+// Reads the whole of path into buffer, which keeps its capacity between files
+static bool ReadFile(const string& path, vector<uchar>& buffer)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool ok = fseek(file, 0, SEEK_END) == 0;
+	long size = ok ? ftell(file) : -1;
+	ok = size > 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok)
+	{
+		buffer.resize(size);
+		ok = fread(&buffer[0], 1, size, file) == (size_t)size;
+	}
+	fclose(file);
+	return ok;
+}
+
+FrameLoader::FrameLoader(const vector<string>& paths, const FrameLoaderParams& params)
+	: paths(paths), params(params), claimed(0), released(0), consumed(0), stopping(false)
+{
+	CV_Assert(params.depth >= 2 && params.threads >= 1);
+
+	slots.resize(params.depth);
+	slotFrames.assign(params.depth, -1);
+	for (int i = 0; i < params.threads; ++i)
+	{
+		workers.push_back(thread(&FrameLoader::Work, this));
+	}
+}
+
+FrameLoader::~FrameLoader()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	slotFreed.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
+
+void FrameLoader::Work()
+{
+	vector<uchar> buffer;
+	for (;;)
+	{
+		int frame;
+		{
+			unique_lock<mutex> guard(lock);
+			int64 start = getTickCount();
+			while (!stopping && claimed < (int)paths.size() && claimed >= released + params.depth)
+			{
+				slotFreed.wait(guard);
+			}
+			stats.decodeStalls += getTickCount() - start;
+			if (stopping || claimed == (int)paths.size())
+			{
+				return;
+			}
+			frame = claimed++;
+		}
+
+		// the slot is ours alone: its previous frame was released and the
+		// next one to land in it cannot be claimed before this one is.
+		// imdecode leaves its destination as it is on a file it cannot
+		// parse, so the slot is emptied first or it would hand out the frame
+		// decoded depth frames ago
+		int64 start = getTickCount();
+		Mat& slot = slots[frame % params.depth];
+		slot.release();
+		if (ReadFile(paths[frame], buffer))
+		{
+			imdecode(buffer, params.flags, &slot);
+		}
+		int64 ticks = getTickCount() - start;
+
+		{
+			lock_guard<mutex> guard(lock);
+			slotFrames[frame % params.depth] = frame;
+			stats.decodeTicks += ticks;
+		}
+		frameReady.notify_one();
+	}
+}
+
+bool FrameLoader::Next(Mat& frame, int* index)
+{
+	unique_lock<mutex> guard(lock);
+
+	// the frame handed out last is given back
+	if (released < consumed)
+	{
+		slotFrames[(consumed - 1) % params.depth] = -1;
+		released = consumed;
+		slotFreed.notify_all();
+	}
+	if (consumed == (int)paths.size())
+	{
+		frame.release();
+		return false;
+	}
+
+	int slot = consumed % params.depth;
+	int64 start = getTickCount();
+	while (slotFrames[slot] != consumed)
+	{
+		frameReady.wait(guard);
+	}
+	stats.consumerStalls += getTickCount() - start;
+
+	frame = slots[slot];
+	if (index)
+	{
+		*index = consumed;
+	}
+	++consumed;
+	++stats.frames;
+	stats.failures += !frame.data;
+	return true;
+}
+
+FrameLoaderStats FrameLoader::GetStats() const
+{
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
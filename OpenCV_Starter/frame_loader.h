@@ -0,0 +1,82 @@
+#ifndef FRAME_LOADER_H
+#define FRAME_LOADER_H
+
+#include <condition_variable>              // std::condition_variable
+#include <mutex>                           // std::mutex
+#include <string>                          // std::string
+#include <thread>                          // std::thread
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+// Settings of a FrameLoader
+struct FrameLoaderParams
+{
+	int depth;   // slots of the ring, at most depth - 1 frames are decoded ahead of the one being warped
+	int threads; // decode workers
+	int flags;   // imread flags, IMREAD_COLOR gives the BGR frames ProcessImg expects
+
+	FrameLoaderParams();
+};
+
+// Counters of a FrameLoader. Ticks are cv::getTickCount() units, wall time,
+// since the stalls are spent asleep.
+struct FrameLoaderStats
+{
+	int64 frames;         // handed out by Next
+	int64 failures;       // of those, files that could not be read or decoded
+	int64 decodeTicks;    // reading and decoding, summed over the workers
+	int64 decodeStalls;   // workers waiting for a free slot, the consumer is the bottleneck
+	int64 consumerStalls; // Next waiting for its frame, decoding is the bottleneck
+
+	FrameLoaderStats();
+};
+
+// Decodes a list of image files ahead of their consumer.
+//
+// Worker threads claim the files in order and imdecode each into a slot of
+// a ring of depth Mats. A slot is emptied before each decode, so a file that
+// fails to decode comes out empty; that costs an image allocation per frame,
+// the file buffer of a worker is kept from frame to frame. A worker that
+// gets depth frames ahead of the consumer sleeps until Next frees a slot, so
+// memory stays bounded however far the decoders could run ahead. Next hands
+// the frames out in file order, whatever order the workers finish them in.
+// Next must be called from one thread only.
+class FrameLoader
+{
+public:
+	// Starts decoding paths right away
+	explicit FrameLoader(const std::vector<std::string>& paths, const FrameLoaderParams& params = FrameLoaderParams());
+
+	// Stops the workers, abandoning the frames not handed out yet
+	~FrameLoader();
+
+	// Waits for the next frame in file order, returns false past the last one.
+	// frame shares the slot and stays valid until the next call; it is empty
+	// when the file could not be read, as with imread. index gets the index
+	// of the frame in paths when not null.
+	bool Next(cv::Mat& frame, int* index = 0);
+
+	FrameLoaderStats GetStats() const;
+
+private:
+	void Work();
+
+	FrameLoader(const FrameLoader&);
+	FrameLoader& operator=(const FrameLoader&);
+
+	std::vector<std::string> paths;
+	FrameLoaderParams params;
+	std::vector<cv::Mat> slots;
+	std::vector<int> slotFrames;         // frame each slot holds, -1 while free or being decoded
+	int claimed;                         // frames taken by the workers
+	int released;                        // frames the consumer is done with, their slots are free
+	int consumed;                        // frames handed out by Next
+	bool stopping;
+	mutable std::mutex lock;             // guards all of the above and stats
+	std::condition_variable slotFreed;   // workers wait on it for released to move
+	std::condition_variable frameReady;  // Next waits on it for its slot
+	std::vector<std::thread> workers;
+	FrameLoaderStats stats;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "frame_writer.h"
+
+#include <cstdio>                          // fopen(), fwrite()
+#include <memory>                          // std::unique_ptr
+#include <opencv2/imgcodecs/imgcodecs.hpp> // cv::imencode()
+#include <opencv2/imgproc/imgproc.hpp>     // cv::cvtColor()
+#include "mapped_image.h"                  // MappedImage
+
+using namespace std;
+using namespace cv;
+
+FrameWriterParams::FrameWriterParams()
+	: format(FRAME_BMP), pngCompression(1), jpegQuality(95), threads(2), depth(8)
+{
+}
+
+FrameWriterStats::FrameWriterStats()
+	: frames(0), failures(0), bytes(0), encodeTicks(0), diskTicks(0), copyTicks(0), stallTicks(0), ticks(0)
+{
+}
+
+// Writes size bytes of data to path
+static bool WriteFile(const string& path, const uchar* data, size_t size)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+FrameWriter::FrameWriter(const FrameWriterParams& params)
+	: params(params), pending(0), stopping(false), firstTick(0)
+{
+	CV_Assert(params.format >= FRAME_BMP && params.format <= FRAME_RAW && params.threads >= 1 && params.depth >= 1);
+
+	if (params.format == FRAME_PNG)
+	{
+		encodeFlags.push_back(IMWRITE_PNG_COMPRESSION);
+		encodeFlags.push_back(params.pngCompression);
+	}
+	else if (params.format == FRAME_JPEG)
+	{
+		encodeFlags.push_back(IMWRITE_JPEG_QUALITY);
+		encodeFlags.push_back(params.jpegQuality);
+	}
+
+	for (int i = 0; i < params.threads; ++i)
+	{
+		workers.push_back(thread(&FrameWriter::Work, this));
+	}
+}
+
+FrameWriter::~FrameWriter()
+{
+	Flush();
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	jobQueued.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		workers[i].join();
+	}
+}
+
+future<bool> FrameWriter::Write(const string& path, const Mat& frame, const Callback& done)
+{
+	CV_Assert(frame.depth() == CV_8U && (frame.channels() == 1 || frame.channels() == 3));
+
+	// owned here until queued, a throwing copy must not leak it
+	unique_ptr<Job> job(new Job);
+	job->path = path;
+	job->done = done;
+	future<bool> result = job->result.get_future();
+
+	unique_lock<mutex> guard(lock);
+	int64 start = getTickCount();
+	if (!firstTick)
+	{
+		firstTick = start;
+	}
+	while (pending >= params.depth)
+	{
+		jobDone.wait(guard);
+	}
+	int64 copyStart = getTickCount();
+	stats.stallTicks += copyStart - start;
+	if (!buffers.empty())
+	{
+		job->frame = buffers.back();
+		buffers.pop_back();
+	}
+	++pending;
+	guard.unlock();
+
+	// copyTo keeps the recycled buffer when the size and type match. Should
+	// it or the queue throw, the slot is given back so Flush does not wait
+	// for a frame that never comes.
+	try
+	{
+		frame.copyTo(job->frame);
+		guard.lock();
+		stats.copyTicks += getTickCount() - copyStart;
+		jobs.push_back(job.get());
+	}
+	catch (...)
+	{
+		if (!guard.owns_lock())
+		{
+			guard.lock();
+		}
+		--pending;
+		guard.unlock();
+		jobDone.notify_all();
+		throw;
+	}
+	job.release();
+	guard.unlock();
+	jobQueued.notify_one();
+	return result;
+}
+
+void FrameWriter::Flush()
+{
+	unique_lock<mutex> guard(lock);
+	while (pending)
+	{
+		jobDone.wait(guard);
+	}
+}
+
+FrameWriterStats FrameWriter::GetStats() const
+{
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
+
+string FrameWriter::Extension(int format, int channels)
+{
+	switch (format)
+	{
+	case FRAME_PNG:
+		return ".png";
+	case FRAME_JPEG:
+		return ".jpg";
+	case FRAME_RAW:
+		return channels == 1 ? ".pgm" : ".ppm";
+	default:
+		return ".bmp";
+	}
+}
+
+void FrameWriter::Work()
+{
+	vector<uchar> encoded;
+	for (;;)
+	{
+		Job* job;
+		{
+			unique_lock<mutex> guard(lock);
+			while (!stopping && jobs.empty())
+			{
+				jobQueued.wait(guard);
+			}
+			if (jobs.empty())
+			{
+				return;
+			}
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		// RAW goes straight from the frame into the mapped file, swapping BGR
+		// to the RGB of P6 on the way; the others are encoded in memory first
+		// so encoding and disk are timed apart
+		bool ok = false;
+		size_t bytes = 0;
+		int64 encodeTicks = 0, start = getTickCount();
+		try
+		{
+			if (params.format == FRAME_RAW)
+			{
+				MappedImage file;
+				ok = file.Create(job->path, job->frame.size(), job->frame.type());
+				if (ok && job->frame.channels() == 3)
+				{
+					cvtColor(job->frame, file.Image(), COLOR_BGR2RGB);
+				}
+				else if (ok)
+				{
+					job->frame.copyTo(file.Image());
+				}
+				bytes = ok ? job->frame.total() * job->frame.elemSize() : 0;
+			}
+			else
+			{
+				ok = imencode(Extension(params.format), job->frame, encoded, encodeFlags);
+				encodeTicks = getTickCount() - start;
+				ok = ok && WriteFile(job->path, &encoded[0], encoded.size());
+				bytes = ok ? encoded.size() : 0;
+			}
+		}
+		catch (...)
+		{
+			// cv::Exception, or bad_alloc from the encoder: the frame failed,
+			// the worker goes on
+			ok = false;
+		}
+		int64 end = getTickCount();
+
+		if (job->done)
+		{
+			try
+			{
+				job->done(job->path, ok, bytes);
+			}
+			catch (...)
+			{
+				// must not escape the worker, see Callback
+			}
+		}
+		job->result.set_value(ok);
+
+		{
+			lock_guard<mutex> guard(lock);
+			++stats.frames;
+			stats.failures += !ok;
+			stats.bytes += bytes;
+			stats.encodeTicks += encodeTicks;
+			stats.diskTicks += end - start - encodeTicks;
+			stats.ticks = getTickCount() - firstTick;
+			buffers.push_back(job->frame);
+			--pending;
+		}
+		jobDone.notify_all();
+		delete job;
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <condition_variable>              // std::condition_variable
+#include <deque>                           // std::deque
+#include <functional>                      // std::function
+#include <future>                          // std::future
+#include <mutex>                           // std::mutex
+#include <string>                          // std::string
+#include <thread>                          // std::thread
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+// File formats of a FrameWriter
+enum FrameFormat
+{
+	FRAME_BMP = 0,  // uncompressed, what main writes by default
+	FRAME_PNG = 1,  // lossless, FrameWriterParams::pngCompression
+	FRAME_JPEG = 2, // lossy, FrameWriterParams::jpegQuality
+	FRAME_RAW = 3   // the pixels behind a PPM/PGM header, no encoding at all; BGR is swapped to the RGB of P6 while copying, imread and MappedImage read it back
+};
+
+// Settings of a FrameWriter
+struct FrameWriterParams
+{
+	int format;         // one of FrameFormat
+	int pngCompression; // IMWRITE_PNG_COMPRESSION, 0 (fastest) to 9 (smallest)
+	int jpegQuality;    // IMWRITE_JPEG_QUALITY, 0 to 100
+	int threads;        // encoding workers
+	int depth;          // frames queued or being encoded before Write blocks
+
+	FrameWriterParams();
+};
+
+// Counters of a FrameWriter. Ticks are cv::getTickCount() units.
+struct FrameWriterStats
+{
+	int64 frames;       // written or failed
+	int64 failures;     // of those, could not be encoded or written
+	int64 bytes;        // written to disk
+	int64 encodeTicks;  // in imencode, summed over the workers
+	int64 diskTicks;    // writing the files, summed over the workers
+	int64 copyTicks;    // in Write, copying the frames
+	int64 stallTicks;   // in Write, waiting for the queue to drain
+	int64 ticks;        // wall time from the first Write to the last frame done
+
+	FrameWriterStats();
+
+	double BytesPerSecond() const { return ticks ? bytes * cv::getTickFrequency() / ticks : 0.; }
+};
+
+// Encodes and writes frames on worker threads, so the thread producing them
+// never waits for an encoder or the disk. Write copies the frame into a
+// recycled buffer and returns; the frame can be overwritten right away.
+// Only when depth frames are still pending does Write block (stallTicks),
+// which bounds the memory when the disk cannot keep up.
+// Files complete in any order. Not thread safe, one producer per writer.
+class FrameWriter
+{
+public:
+	// Called on a worker thread once path is written, or failed to be. It
+	// should not throw; an exception it throws is dropped.
+	typedef std::function<void(const std::string& path, bool ok, size_t bytes)> Callback;
+
+	explicit FrameWriter(const FrameWriterParams& params = FrameWriterParams());
+
+	// Waits for the pending frames, then stops the workers
+	~FrameWriter();
+
+	// Queues frame, 8-bit with 1 or 3 channels, to be written to path in the
+	// format of the params whatever the extension of path. The future gets
+	// whether it made it to disk, done is called when set. Whatever copying
+	// the frame throws is rethrown, nothing is queued then.
+	std::future<bool> Write(const std::string& path, const cv::Mat& frame, const Callback& done = Callback());
+
+	// Waits until every queued frame is written
+	void Flush();
+
+	FrameWriterStats GetStats() const;
+
+	// File extension of format, with the dot; RAW depends on the channels
+	static std::string Extension(int format, int channels = 3);
+
+private:
+	struct Job
+	{
+		std::string path;
+		cv::Mat frame;
+		Callback done;
+		std::promise<bool> result;
+	};
+
+	void Work();
+
+	FrameWriter(const FrameWriter&);
+	FrameWriter& operator=(const FrameWriter&);
+
+	FrameWriterParams params;
+	std::vector<int> encodeFlags;        // imencode params of the format
+	std::deque<Job*> jobs;               // queued, not yet taken by a worker
+	std::vector<cv::Mat> buffers;        // frames of finished jobs, reused by Write
+	int pending;                         // jobs queued or being encoded
+	bool stopping;
+	int64 firstTick;                     // of the first Write, 0 before
+	mutable std::mutex lock;             // guards all of the above and stats
+	std::condition_variable jobQueued;   // workers wait on it for jobs
+	std::condition_variable jobDone;     // Write and Flush wait on it for pending to drop
+	std::vector<std::thread> workers;
+	FrameWriterStats stats;
+};
+
+#endif
@@ -0,0 +1,565 @@
+#include "homography.h"
+
+#include <cfloat>                          // DBL_EPSILON
+#include <opencv2/hal/intrin.hpp>          // v_float32x4
+
+using namespace cv;
+
+// The unit square corners land at w = 1, 1 + g, 1 + g + h and 1 + h. All
+// positive means the square does not cross the horizon, so the quad is convex;
+// a zero den or cross means collinear corners. A zero den also turns g and h
+// into inf or nan, which fail the compares on their own.
+template<typename T>
+static bool SquareToQuadT(const Point2f quad[4], Matx<T, 3, 3>& H)
+{
+	T x0 = quad[0].x, y0 = quad[0].y, x1 = quad[1].x, y1 = quad[1].y;
+	T x2 = quad[2].x, y2 = quad[2].y, x3 = quad[3].x, y3 = quad[3].y;
+
+	T dx1 = x1 - x2, dy1 = y1 - y2;
+	T dx2 = x3 - x2, dy2 = y3 - y2;
+	T sx = x0 - x1 + x2 - x3;
+	T sy = y0 - y1 + y2 - y3;
+	T den = dx1 * dy2 - dy1 * dx2;
+
+	T g = (sx * dy2 - sy * dx2) / den;
+	T h = (sy * dx1 - sx * dy1) / den;
+
+	H = Matx<T, 3, 3>(x1 - x0 + g * x1, x3 - x0 + h * x3, x0,
+		y1 - y0 + g * y1, y3 - y0 + h * y3, y0,
+		g, h, 1);
+
+	T cross = (x1 - x0) * (y3 - y0) - (y1 - y0) * (x3 - x0);
+	return den != 0 && cross != 0 && 1 + g > 0 && 1 + h > 0 && 1 + g + h > 0;
+}
+
+bool SquareToQuad(const Point2f quad[4], Matx33f& H)
+{
+	return SquareToQuadT(quad, H);
+}
+
+bool SquareToQuad(const Point2f quad[4], Matx33d& H)
+{
+	return SquareToQuadT(quad, H);
+}
+
+int SquareToQuadBatch(const float* const qx[4], const float* const qy[4], int count, float* const h[8], uchar* valid)
+{
+	int degenerate = 0;
+	int i = 0;
+#if CV_SIMD128
+	const v_float32x4 vZero = v_setzero_f32();
+	const v_float32x4 vOne = v_setall_f32(1.f);
+
+	for (; i <= count - 4; i += 4)
+	{
+		v_float32x4 x0 = v_load(qx[0] + i), y0 = v_load(qy[0] + i);
+		v_float32x4 x1 = v_load(qx[1] + i), y1 = v_load(qy[1] + i);
+		v_float32x4 x2 = v_load(qx[2] + i), y2 = v_load(qy[2] + i);
+		v_float32x4 x3 = v_load(qx[3] + i), y3 = v_load(qy[3] + i);
+
+		v_float32x4 dx1 = x1 - x2, dy1 = y1 - y2;
+		v_float32x4 dx2 = x3 - x2, dy2 = y3 - y2;
+		v_float32x4 sx = x0 - x1 + x2 - x3;
+		v_float32x4 sy = y0 - y1 + y2 - y3;
+		v_float32x4 den = dx1 * dy2 - dy1 * dx2;
+
+		v_float32x4 g = (sx * dy2 - sy * dx2) / den;
+		v_float32x4 hh = (sy * dx1 - sx * dy1) / den;
+
+		v_store(h[0] + i, x1 - x0 + g * x1);
+		v_store(h[1] + i, x3 - x0 + hh * x3);
+		v_store(h[2] + i, x0);
+		v_store(h[3] + i, y1 - y0 + g * y1);
+		v_store(h[4] + i, y3 - y0 + hh * y3);
+		v_store(h[5] + i, y0);
+		v_store(h[6] + i, g);
+		v_store(h[7] + i, hh);
+
+		// same test as SquareToQuadT, one sign mask per 4 quads
+		v_float32x4 cross = (x1 - x0) * (y3 - y0) - (y1 - y0) * (x3 - x0);
+		v_float32x4 ok = (den != vZero) & (cross != vZero) & (vOne + g > vZero) & (vOne + hh > vZero) &
+			(vOne + g + hh > vZero);
+		int mask = v_signmask(ok);
+
+		if (mask != 15)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				degenerate += !((mask >> k) & 1);
+			}
+		}
+		if (valid)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				valid[i + k] = (uchar)((mask >> k) & 1);
+			}
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		Point2f quad[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			quad[k] = Point2f(qx[k][i], qy[k][i]);
+		}
+
+		Matx33f H;
+		bool ok = SquareToQuad(quad, H);
+		for (int j = 0; j < 8; ++j)
+		{
+			h[j][i] = H.val[j];
+		}
+
+		degenerate += !ok;
+		if (valid)
+		{
+			valid[i] = (uchar)ok;
+		}
+	}
+	return degenerate;
+}
+
+RansacStats::RansacStats()
+	: hypotheses(0), rounds(0), inliers(0), refits(0)
+{
+}
+
+RansacParams::RansacParams()
+	: threshold(3), confidence(0.995), maxIterations(2000), roundSize(64), seed(0x5eed), stats(0)
+{
+}
+
+// Normalized correspondences as structure of arrays
+struct PointSet
+{
+	std::vector<float> sx, sy; // source
+	std::vector<float> dx, dy; // destination
+	int count;
+	Matx33d srcT, dstT;        // pixel -> normalized
+	float thresh2;             // squared inlier threshold in normalized destination units
+};
+
+// Copies pts into x and y moved so their centroid is the origin and their
+// mean distance to it is sqrt(2); T gets that transform
+static void Normalize(const std::vector<Point2f>& pts, std::vector<float>& x, std::vector<float>& y, Matx33d& T)
+{
+	const int n = (int)pts.size();
+	x.resize(n);
+	y.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		x[i] = pts[i].x;
+		y[i] = pts[i].y;
+	}
+
+	double sumX = 0, sumY = 0, sumDist = 0;
+	int i = 0;
+#if CV_SIMD128
+	v_float32x4 vSumX = v_setzero_f32(), vSumY = v_setzero_f32();
+	for (; i <= n - 4; i += 4)
+	{
+		vSumX += v_load(&x[i]);
+		vSumY += v_load(&y[i]);
+	}
+	sumX = v_reduce_sum(vSumX);
+	sumY = v_reduce_sum(vSumY);
+#endif
+	for (; i < n; ++i)
+	{
+		sumX += x[i];
+		sumY += y[i];
+	}
+	const float cx = (float)(sumX / n), cy = (float)(sumY / n);
+
+	i = 0;
+#if CV_SIMD128
+	const v_float32x4 vCx = v_setall_f32(cx), vCy = v_setall_f32(cy);
+	v_float32x4 vDist = v_setzero_f32();
+	for (; i <= n - 4; i += 4)
+	{
+		v_float32x4 ex = v_load(&x[i]) - vCx, ey = v_load(&y[i]) - vCy;
+		vDist += v_sqrt(ex * ex + ey * ey);
+	}
+	sumDist = v_reduce_sum(vDist);
+#endif
+	for (; i < n; ++i)
+	{
+		sumDist += std::sqrt((x[i] - cx) * (x[i] - cx) + (y[i] - cy) * (y[i] - cy));
+	}
+	const float scale = sumDist > 0 ? (float)(std::sqrt(2.) * n / sumDist) : 1.f;
+
+	i = 0;
+#if CV_SIMD128
+	const v_float32x4 vScale = v_setall_f32(scale);
+	for (; i <= n - 4; i += 4)
+	{
+		v_store(&x[i], (v_load(&x[i]) - vCx) * vScale);
+		v_store(&y[i], (v_load(&y[i]) - vCy) * vScale);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		x[i] = (x[i] - cx) * scale;
+		y[i] = (y[i] - cy) * scale;
+	}
+
+	T = Matx33d(scale, 0, -(double)scale * cx, 0, scale, -(double)scale * cy, 0, 0, 1);
+}
+
+// Solves A h = b by Gaussian elimination with partial pivoting, A and b are
+// overwritten. False when A is singular or nearly so.
+static bool Solve8(double A[8][8], double b[8], double h[8])
+{
+	double maxAbs = 0;
+	for (int r = 0; r < 8; ++r)
+	{
+		for (int c = 0; c < 8; ++c)
+		{
+			maxAbs = std::max(maxAbs, std::abs(A[r][c]));
+		}
+	}
+	const double eps = maxAbs * 1e-10;
+
+	for (int c = 0; c < 8; ++c)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < 8; ++r)
+		{
+			if (std::abs(A[r][c]) > std::abs(A[pivot][c]))
+			{
+				pivot = r;
+			}
+		}
+		if (!(std::abs(A[pivot][c]) > eps))
+		{
+			return false;
+		}
+		if (pivot != c)
+		{
+			for (int k = c; k < 8; ++k)
+			{
+				std::swap(A[c][k], A[pivot][k]);
+			}
+			std::swap(b[c], b[pivot]);
+		}
+
+		for (int r = c + 1; r < 8; ++r)
+		{
+			double f = A[r][c] / A[c][c];
+			for (int k = c; k < 8; ++k)
+			{
+				A[r][k] -= f * A[c][k];
+			}
+			b[r] -= f * b[c];
+		}
+	}
+
+	for (int r = 7; r >= 0; --r)
+	{
+		double sum = b[r];
+		for (int k = r + 1; k < 8; ++k)
+		{
+			sum -= A[r][k] * h[k];
+		}
+		h[r] = sum / A[r][r];
+	}
+	return true;
+}
+
+// The two DLT rows of correspondence i with h33 = 1
+static inline void DltRows(const PointSet& ps, int i, double r0[8], double r1[8], double& b0, double& b1)
+{
+	double x = ps.sx[i], y = ps.sy[i], u = ps.dx[i], v = ps.dy[i];
+	double row0[8] = { x, y, 1, 0, 0, 0, -u * x, -u * y };
+	double row1[8] = { 0, 0, 0, x, y, 1, -v * x, -v * y };
+	for (int k = 0; k < 8; ++k)
+	{
+		r0[k] = row0[k];
+		r1[k] = row1[k];
+	}
+	b0 = u;
+	b1 = v;
+}
+
+// Homography through the 4 correspondences idx, false for a degenerate sample
+static bool SolveSample(const PointSet& ps, const int idx[4], Matx33d& H)
+{
+	double A[8][8], b[8], h[8];
+	for (int k = 0; k < 4; ++k)
+	{
+		DltRows(ps, idx[k], A[k * 2], A[k * 2 + 1], b[k * 2], b[k * 2 + 1]);
+	}
+	if (!Solve8(A, b, h))
+	{
+		return false;
+	}
+	H = Matx33d(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], 1);
+	return true;
+}
+
+// Least squares homography over the correspondences mask marks
+static bool Refit(const PointSet& ps, const std::vector<uchar>& mask, Matx33d& H)
+{
+	double AtA[8][8] = {}, Atb[8] = {}, h[8];
+	for (int i = 0; i < ps.count; ++i)
+	{
+		if (!mask[i])
+		{
+			continue;
+		}
+		double r[2][8], b[2];
+		DltRows(ps, i, r[0], r[1], b[0], b[1]);
+		for (int k = 0; k < 2; ++k)
+		{
+			for (int p = 0; p < 8; ++p)
+			{
+				for (int q = 0; q < 8; ++q)
+				{
+					AtA[p][q] += r[k][p] * r[k][q];
+				}
+				Atb[p] += r[k][p] * b[k];
+			}
+		}
+	}
+	if (!Solve8(AtA, Atb, h))
+	{
+		return false;
+	}
+	H = Matx33d(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], 1);
+	return true;
+}
+
+// Number of correspondences H maps within the threshold. With a mask every
+// point is scored and marked; without one, scoring gives up as soon as even
+// all remaining points could not bring the count to beat, the partial count
+// returned is then below beat.
+static int CountInliers(const PointSet& ps, const Matx33d& H, int beat, uchar* mask)
+{
+	const float* sx = &ps.sx[0];
+	const float* sy = &ps.sy[0];
+	const float* dx = &ps.dx[0];
+	const float* dy = &ps.dy[0];
+	const int n = ps.count;
+	const float h[9] = { (float)H(0, 0), (float)H(0, 1), (float)H(0, 2), (float)H(1, 0), (float)H(1, 1),
+		(float)H(1, 2), (float)H(2, 0), (float)H(2, 1), (float)H(2, 2) };
+	int inliers = 0;
+	int i = 0;
+
+#if CV_SIMD128
+	v_float32x4 vh[9];
+	for (int k = 0; k < 9; ++k)
+	{
+		vh[k] = v_setall_f32(h[k]);
+	}
+	const v_float32x4 vOne = v_setall_f32(1.f);
+	const v_float32x4 vThresh2 = v_setall_f32(ps.thresh2);
+	v_int32x4 vCount = v_setzero_s32();
+
+	// 8 correspondences per iteration, a point at infinity gives inf or nan
+	// and fails the compare
+	for (; i <= n - 8; i += 8)
+	{
+		for (int half = 0; half < 8; half += 4)
+		{
+			v_float32x4 x = v_load(sx + i + half), y = v_load(sy + i + half);
+			v_float32x4 invW = vOne / v_muladd(vh[6], x, v_muladd(vh[7], y, vh[8]));
+			v_float32x4 ex = v_muladd(vh[0], x, v_muladd(vh[1], y, vh[2])) * invW - v_load(dx + i + half);
+			v_float32x4 ey = v_muladd(vh[3], x, v_muladd(vh[4], y, vh[5])) * invW - v_load(dy + i + half);
+			v_float32x4 in = ex * ex + ey * ey < vThresh2;
+			vCount -= v_reinterpret_as_s32(in);
+
+			if (mask)
+			{
+				int bits = v_signmask(in);
+				for (int k = 0; k < 4; ++k)
+				{
+					mask[i + half + k] = (uchar)((bits >> k) & 1);
+				}
+			}
+		}
+
+		if (!mask && (i & 63) == 56 && v_reduce_sum(vCount) + n - i - 8 < beat)
+		{
+			return v_reduce_sum(vCount);
+		}
+	}
+	inliers = v_reduce_sum(vCount);
+#endif
+	for (; i < n; ++i)
+	{
+		float invW = 1.f / (h[6] * sx[i] + h[7] * sy[i] + h[8]);
+		float ex = (h[0] * sx[i] + h[1] * sy[i] + h[2]) * invW - dx[i];
+		float ey = (h[3] * sx[i] + h[4] * sy[i] + h[5]) * invW - dy[i];
+		bool in = ex * ex + ey * ey < ps.thresh2;
+		inliers += in;
+		if (mask)
+		{
+			mask[i] = (uchar)in;
+		}
+	}
+	return inliers;
+}
+
+// Solves and scores hypotheses first + range of one round. Each draws its
+// sample from its own generator seeded by its index, so the result does not
+// depend on which thread runs it.
+class HypothesisInvoker : public ParallelLoopBody
+{
+public:
+	HypothesisInvoker(const PointSet& ps, uint64 seed, int first, int beat, Matx33d* models, int* scores)
+		: ps(ps), seed(seed), first(first), beat(beat), models(models), scores(scores)
+	{
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		for (int k = range.start; k < range.end; ++k)
+		{
+			RNG rng(seed + (uint64)(first + k) * 0x9E3779B97F4A7C15ULL);
+			int idx[4];
+			for (int j = 0; j < 4; ++j)
+			{
+				bool repeated;
+				do
+				{
+					idx[j] = rng.uniform(0, ps.count);
+					repeated = false;
+					for (int p = 0; p < j; ++p)
+					{
+						repeated = repeated || idx[p] == idx[j];
+					}
+				} while (repeated);
+			}
+
+			scores[k] = -1;
+			if (SolveSample(ps, idx, models[k]))
+			{
+				scores[k] = CountInliers(ps, models[k], beat, 0);
+			}
+		}
+	}
+
+private:
+	const PointSet& ps;
+	uint64 seed;
+	int first;
+	int beat;
+	Matx33d* models;
+	int* scores;
+};
+
+bool EstimateHomography(const std::vector<Point2f>& src, const std::vector<Point2f>& dst, Matx33d& H,
+	const RansacParams& params, std::vector<uchar>* inlierMask)
+{
+	CV_Assert(src.size() == dst.size());
+	CV_Assert(params.threshold > 0 && params.confidence > 0 && params.confidence < 1);
+	CV_Assert(params.maxIterations > 0 && params.roundSize > 0);
+
+	RansacStats stats;
+	const int n = (int)src.size();
+	if (n < 4)
+	{
+		if (params.stats)
+		{
+			*params.stats = stats;
+		}
+		return false;
+	}
+
+	PointSet ps;
+	Normalize(src, ps.sx, ps.sy, ps.srcT);
+	Normalize(dst, ps.dx, ps.dy, ps.dstT);
+	ps.count = n;
+	double thresh = params.threshold * ps.dstT(0, 0);
+	ps.thresh2 = (float)(thresh * thresh);
+
+	std::vector<Matx33d> models(params.roundSize);
+	std::vector<int> scores(params.roundSize);
+	Matx33d best;
+	int bestScore = -1;
+	int needed = params.maxIterations;
+
+	while (stats.hypotheses < needed)
+	{
+		int round = std::min(params.roundSize, needed - stats.hypotheses);
+		parallel_for_(Range(0, round), HypothesisInvoker(ps, params.seed, stats.hypotheses, bestScore + 1, &models[0], &scores[0]));
+		++stats.rounds;
+		stats.hypotheses += round;
+
+		// the lowest index wins ties, again for a thread count independent result
+		for (int k = 0; k < round; ++k)
+		{
+			if (scores[k] > bestScore)
+			{
+				bestScore = scores[k];
+				best = models[k];
+			}
+		}
+
+		// hypotheses needed to draw an all inlier sample with the given confidence
+		if (bestScore > 0)
+		{
+			double allInliers = std::pow((double)bestScore / n, 4.);
+			if (allInliers >= 1. - DBL_EPSILON)
+			{
+				break;
+			}
+			double iterations = std::log(1. - params.confidence) / std::log(1. - allInliers);
+			needed = (int)std::min((double)params.maxIterations, std::ceil(iterations));
+		}
+	}
+
+	bool found = bestScore >= 4;
+	std::vector<uchar> mask(n);
+	if (found)
+	{
+		stats.inliers = CountInliers(ps, best, 0, &mask[0]);
+
+		// refit on the inliers while that keeps or grows the set
+		std::vector<uchar> refitMask(n);
+		for (int pass = 0; pass < 3; ++pass)
+		{
+			Matx33d refit;
+			if (!Refit(ps, mask, refit))
+			{
+				break;
+			}
+			++stats.refits;
+			int inliers = CountInliers(ps, refit, 0, &refitMask[0]);
+			if (inliers < stats.inliers)
+			{
+				break;
+			}
+			best = refit;
+			mask.swap(refitMask);
+			bool grew = inliers > stats.inliers;
+			stats.inliers = inliers;
+			if (!grew)
+			{
+				break;
+			}
+		}
+
+		// back to pixels: dstT^-1 * best * srcT
+		const Matx33d& T = ps.dstT;
+		Matx33d invT(1. / T(0, 0), 0, -T(0, 2) / T(0, 0), 0, 1. / T(1, 1), -T(1, 2) / T(1, 1), 0, 0, 1);
+		H = invT * best * ps.srcT;
+		H *= 1. / H(2, 2);
+	}
+
+	if (inlierMask)
+	{
+		inlierMask->assign(n, 0);
+		if (found)
+		{
+			inlierMask->swap(mask);
+		}
+	}
+	if (params.stats)
+	{
+		*params.stats = stats;
+	}
+	return found;
+}
@@ -0,0 +1,62 @@
+#ifndef HOMOGRAPHY_H
+#define HOMOGRAPHY_H
+
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Matx33f
+
+// Homography taking the unit square corners (0, 0), (1, 0), (1, 1), (0, 1)
+// onto quad[0..3], the closed form GetProjMat uses. Nothing is allocated.
+// Returns false when the quad is degenerate, i.e. not strictly convex or with
+// collinear corners; H is then not usable. The check is a few compares on
+// values the solve computes anyway.
+bool SquareToQuad(const cv::Point2f quad[4], cv::Matx33f& H);
+bool SquareToQuad(const cv::Point2f quad[4], cv::Matx33d& H);
+
+// SquareToQuad over count quads at once, 4 per v_float32x4 iteration.
+// Structure of arrays: corner k of quad i is (qx[k][i], qy[k][i]) and
+// coefficient j of its row major homography goes to h[j][i], j = 0..7 (the
+// ninth is always 1). valid[i], when given, gets 0 for a degenerate quad.
+// Returns the number of degenerate quads.
+int SquareToQuadBatch(const float* const qx[4], const float* const qy[4], int count, float* const h[8], uchar* valid = 0);
+
+// Counters of one EstimateHomography call
+struct RansacStats
+{
+	int hypotheses; // minimal samples solved and scored
+	int rounds;     // parallel batches of hypotheses
+	int inliers;    // of the returned homography
+	int refits;     // least squares passes over the inliers
+
+	RansacStats();
+};
+
+// Settings of EstimateHomography
+struct RansacParams
+{
+	double threshold;   // reprojection error in destination pixels that makes an inlier
+	double confidence;  // stop once an outlier free sample was drawn with this probability
+	int maxIterations;  // hypotheses at most
+	int roundSize;      // hypotheses solved and scored in parallel per round
+	uint64 seed;        // the samples depend only on this, not on the thread count
+	RansacStats* stats; // filled in when not null
+
+	RansacParams();
+};
+
+// Robust src -> dst homography from noisy correspondences, for the same job
+// as findHomography with RANSAC:
+// - both point sets are normalized (centroid to the origin, mean distance
+//   sqrt(2)) with v_float32x4 sums, the DLT runs on normalized coordinates
+// - each hypothesis is an 8x8 solve on a random 4 point sample, scored over
+//   8 correspondences per iteration; scoring stops early once the remaining
+//   points cannot beat the best hypothesis
+// - hypotheses run roundSize at a time through cv::parallel_for_, after each
+//   round the needed iteration count is updated from the best inlier ratio
+//   and the search stops once confidence is reached
+// - the best hypothesis is refit by least squares on its inliers
+// Returns false when there are fewer than 4 points or no sample was usable.
+// inlierMask, when given, gets 1 for every inlier of H.
+bool EstimateHomography(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst, cv::Matx33d& H,
+	const RansacParams& params = RansacParams(), std::vector<uchar>* inlierMask = 0);
+
+#endif
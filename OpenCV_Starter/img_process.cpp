@@ -0,0 +1,88 @@
+#include "img_process.h"
+
+#include <opencv2/imgproc/imgproc.hpp>     // cv::getPerspective()
+#include "court_detector.h"                // CourtDetector
+#include "homography.h"                    // SquareToQuad()
+#include "warp_engine.h"                   // WarpImg()
+
+using namespace std;
+using namespace cv;
+
+vector<Point2f> gDistortPts; // Court corners of the input
+vector<Point2f> gTargetPts; // The output
+
+bool InitPickPoints(const Mat& frame)
+{
+	// 4 distored points: left bottom, left top, right top, right bottom
+	CourtDetector detector;
+	Point2f corners[4];
+	if (!detector.Detect(frame, corners))
+	{
+		return false;
+	}
+	gDistortPts.assign(corners, corners + 4);
+	return true;
+}
+
+void InitOutputPts(Size size)
+{
+	// these will be the parallel plane vector of point 
+	// 4 None distorted point
+	gTargetPts.clear();
+	gTargetPts.push_back(Point2f(0, 0));
+	gTargetPts.push_back(Point2f(size.width - 1.f, 0));
+	gTargetPts.push_back(Point2f(size.width - 1.f, size.height - 1.f));
+	gTargetPts.push_back(Point2f(0, size.height - 1.f));
+}
+
+Matx33f GetProjMat(const Point2f src[], int targetRowSize, int targetColSize)
+{
+	Matx33f C;
+	bool convex = SquareToQuad(src, C);
+	CV_Assert(convex);
+
+	// C maps the unit square onto the quad, so target pixels are first scaled
+	// into the unit square: C * diag(1 / (cols - 1), 1 / (rows - 1), 1), done
+	// in place. The result maps target -> source.
+	float sx = 1.f / (targetColSize - 1);
+	float sy = 1.f / (targetRowSize - 1);
+	for (int r = 0; r < 3; ++r)
+	{
+		C(r, 0) *= sx;
+		C(r, 1) *= sy;
+	}
+
+	return C;
+}
+
+// Using home made transform function
+void ProcessImg(Mat& src, Mat& dest)
+{
+	Matx33f transformationMatrix = GetProjMat(&gDistortPts[0], dest.rows, dest.cols);
+
+	// GetProjMat already maps target -> source, which is the direction the
+	// inverse mapping warp walks in, so no inversion is needed
+	WarpParams params;
+	params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+	params.borderMode = BORDER_CONSTANT;
+	WarpImg(src, dest, transformationMatrix, params);
+}
+
+void ProcessImg(const WarpBuffer& src, const WarpBuffer& dest, int numThreads)
+{
+	Matx33f transformationMatrix = GetProjMat(&gDistortPts[0], dest.size.height, dest.size.width);
+
+	WarpParams params;
+	params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+	params.borderMode = BORDER_CONSTANT;
+	params.numThreads = numThreads;
+	WarpImg(src, dest, transformationMatrix, params);
+}
+
+// Using OpenCV built-in
+void ProcessImgCV(Mat& src, Mat& dest)
+{
+	//TODO:
+	Mat transformationMatrix = getPerspectiveTransform(&gDistortPts[0], &gTargetPts[0]);
+	warpPerspective(src, dest, transformationMatrix, dest.size(), CV_INTER_LINEAR, BORDER_ISOLATED);
+}
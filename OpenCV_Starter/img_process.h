@@ -0,0 +1,38 @@
+#ifndef IMG_PROCESS_H
+#define IMG_PROCESS_H
+
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+#include "warp_engine.h"                   // WarpBuffer
+
+#define TARGET_ROW 500 // the default row size of target frame, img_wrap --size overrides it
+#define TARGET_COL 940 // the default col size of target frame
+
+extern std::vector<cv::Point2f> gDistortPts; // Court corners of the input
+extern std::vector<cv::Point2f> gTargetPts; // The output
+
+// Sets gDistortPts to the court corners CourtDetector finds in frame,
+// returns false when there is no court
+bool InitPickPoints(const cv::Mat& frame);
+
+// Sets gTargetPts to the corners of a size target frame
+void InitOutputPts(cv::Size size = cv::Size(TARGET_COL, TARGET_ROW));
+
+// Homography mapping target pixels of a targetRowSize x targetColSize frame
+// onto the quad src (left bottom, left top, right top, right bottom).
+// Allocates nothing, asserts the quad is convex.
+cv::Matx33f GetProjMat(const cv::Point2f src[], int targetRowSize, int targetColSize);
+
+// Rectifies the gDistortPts quad of src into dest with the warp engine,
+// dest sets the output size
+void ProcessImg(cv::Mat& src, cv::Mat& dest);
+
+// ProcessImg from and into caller memory, the output written in place into
+// dest; see WarpImg on WarpBuffers for what is checked and what is not
+// allocated
+void ProcessImg(const WarpBuffer& src, const WarpBuffer& dest, int numThreads = 0);
+
+// Using OpenCV built-in, maps gDistortPts onto gTargetPts
+void ProcessImgCV(cv::Mat& src, cv::Mat& dest);
+
+#endif
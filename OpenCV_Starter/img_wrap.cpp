@@ -1,112 +1,440 @@
+#include <cstdio>                          // printf, sscanf
 #include <iostream>                        // std::cout
+#include <string>                          // std::string
+#include <vector>                          // std::vector
 #include <opencv2/core/core.hpp>           // cv::Mat
+#include <opencv2/core/utility.hpp>        // cv::CommandLineParser
 #include <opencv2/highgui/highgui.hpp>     // cv::imread()
 #include <opencv2/imgproc/imgproc.hpp>     // cv::getPerspective()
+#include <opencv2/videoio/videoio.hpp>     // cv::VideoWriter::fourcc()
+#include "court_detector.h"                // CourtDetector
+#include "frame_loader.h"                  // FrameLoader
+#include "frame_writer.h"                  // FrameWriter
+#include "homography.h"                    // SquareToQuad()
+#include "img_process.h"                   // ProcessImg()
+#include "shm_ring.h"                      // ShmRingWriter
+#include "video_pipeline.h"                // RectifyVideo()
+#include "warp_cache.h"                    // WarpMapCache, TemporalWarp
 
 using namespace std;
 using namespace cv;
 
-#define TARGET_ROW 500 // the row size of target frame
-#define TARGET_COL 940 // the col size of target frame
+// What rectifies the court, --backend
+enum Backend
+{
+	BACKEND_ENGINE = 0, // ProcessImg
+	BACKEND_CACHE = 1,  // the warp engine through a WarpMapCache, the maps of fixed --corners are built once; tracked corners go through a TemporalWarp like the engine's
+	BACKEND_OPENCV = 2  // ProcessImgCV
+};
 
-vector<Point2f> gDistortPts; // Hand Picked on Sample 
-vector<Point2f> gTargetPts; // The output
+// Parses "x,y,x,y,x,y,x,y" into four corners, which must go round a convex
+// quad as GetProjMat asserts
+static bool ParseCorners(const string& text, vector<Point2f>& corners)
+{
+	float v[8];
+	char end;
+	if (sscanf(text.c_str(), "%f,%f,%f,%f,%f,%f,%f,%f%c", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &end) != 8)
+	{
+		return false;
+	}
+	corners.clear();
+	for (int i = 0; i < 4; ++i)
+	{
+		corners.push_back(Point2f(v[i * 2], v[i * 2 + 1]));
+	}
+	Matx33f H;
+	return SquareToQuad(&corners[0], H);
+}
 
-void InitPickPoints()
+// Parses "<width>x<height>", GetProjMat needs at least 2 pixels each way
+static bool ParseSize(const string& text, Size& size)
 {
-	// 4 distored points
-	gDistortPts.push_back(Point2f(22, 193)); // left bottom
-	gDistortPts.push_back(Point2f(246, 50)); // left top
-	gDistortPts.push_back(Point2f(402, 74)); // right top
-	gDistortPts.push_back(Point2f(278, 279)); // right bottom
+	char end;
+	return sscanf(text.c_str(), "%dx%d%c", &size.width, &size.height, &end) == 2 && size.width > 1 && size.height > 1;
 }
 
-void InitOutputPts()
+// FrameFormat of a --format name or a file extension, -1 when unknown
+static int ParseFormat(const string& name)
 {
-	// these will be the parallel plane vector of point 
-	// 4 None distorted point
-	gTargetPts.push_back(Point2f(0, 0));
-	gTargetPts.push_back(Point2f(TARGET_COL - 1, 0));
-	gTargetPts.push_back(Point2f(TARGET_COL - 1, TARGET_ROW - 1));
-	gTargetPts.push_back(Point2f(0, TARGET_ROW - 1));
+	return name == "bmp" ? FRAME_BMP : name == "png" ? FRAME_PNG : name == "jpg" || name == "jpeg" ? FRAME_JPEG
+		: name == "raw" || name == "ppm" || name == "pgm" ? FRAME_RAW : -1;
 }
 
-Mat GetProjMat(const Point2f src[], int targetRowSize, int targetColSize)
+// dir/<name of input without its extension><extension>
+static string OutputName(const string& input, const string& dir, const string& extension)
 {
-	float dx1 = src[1].x - src[2].x; //
-	float dy1 = src[1].y - src[2].y; //
+	size_t slash = input.find_last_of("/\\");
+	string name = input.substr(slash == string::npos ? 0 : slash + 1);
+	return dir + "/" + name.substr(0, name.find_last_of('.')) + extension;
+}
 
-	float dx2 = src[3].x - src[2].x; //
-	float dy2 = src[3].y - src[2].y; //
+// Rectifies the gDistortPts quad of src into dest with backend. temporal is
+// given when CourtDetector tracks the corners frame to frame: the engine
+// then keeps its maps while the corners move less than its epsilon instead
+// of building them for every frame. The cache backend goes through temporal
+// too then, as the detected corners never repeat exactly and every frame
+// would add another entry to the cache.
+static void Rectify(Mat& src, Mat& dest, int backend, WarpMapCache& cache, TemporalWarp* temporal)
+{
+	if (backend == BACKEND_OPENCV)
+	{
+		ProcessImgCV(src, dest);
+	}
+	else if (temporal)
+	{
+		// the settings of ProcessImg
+		temporal->Warp(src, &gDistortPts[0], dest);
+	}
+	else if (backend == BACKEND_CACHE)
+	{
+		WarpParams params;
+		params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+		cache.Warp(src, dest, GetProjMat(&gDistortPts[0], dest.rows, dest.cols), params);
+	}
+	else
+	{
+		ProcessImg(src, dest);
+	}
+}
 
-	float ZGMx = src[0].x - src[1].x + src[2].x - src[3].x; //
-	float ZGMy = src[0].y - src[1].y + src[2].y - src[3].y; //
+// Prints how often Rectify could reuse the maps of tracked corners
+static void PrintMapReuse(const TemporalWarp& temporal)
+{
+	TemporalWarpStats stats = temporal.GetStats();
+	if (stats.frames)
+	{
+		printf("  maps reused for %lld of %lld frames, rebuilt %lld times\n", (long long)(stats.frames - stats.rebuilds),
+			(long long)stats.frames, (long long)stats.rebuilds);
+	}
+}
 
-	float g = (ZGMx * dy2 - ZGMy * dx2) / (dx1 * dy2 - dy1 * dx2); //
-	float h = (ZGMy * dx1 - ZGMx * dy1) / (dx1 * dy2 - dy1 * dx2); //
+// Rectifies inputs[i] into outputs[i] without any window, decoding ahead on
+// decoders threads and encoding behind on the writer's. With corners empty
+// CourtDetector finds the court in every frame, tracking it from one to the
+// next. Prints the throughput, returns the number of inputs that did not
+// make it to an output.
+static int RunHeadless(const vector<string>& inputs, const vector<string>& outputs, const vector<Point2f>& corners,
+	Size size, int backend, int decoders, const FrameWriterParams& writerParams)
+{
+	FrameLoaderParams loaderParams;
+	loaderParams.threads = decoders;
+	FrameLoader loader(inputs, loaderParams);
+	FrameWriter writer(writerParams);
+	CourtDetector detector;
+	WarpMapCache cache;
+	TemporalWarp temporal;
 
-	float a = src[1].x - src[0].x + g * src[1].x; //
-	float b = src[3].x - src[0].x + h * src[3].x; //
-	float c = src[0].x; //
-	float d = src[1].y - src[0].y + g * src[1].y; //
-	float e = src[3].y - src[0].y + h * src[3].y; //
-	float f = src[0].y;
+	if (!corners.empty())
+	{
+		gDistortPts = corners;
+	}
+	InitOutputPts(size);
 
-	Mat C = (Mat_<float>(3, 3) << a, b, c, d, e, f, g, h, 1);
+	// runs on the writer's threads
+	FrameWriter::Callback done = [](const string& path, bool ok, size_t)
+	{
+		if (!ok)
+		{
+			printf(" Image writing failed: %s \n", path.c_str());
+		}
+	};
 
-	//cout << C << endl;
+	Mat frame;
+	Mat outputImg(size, CV_8UC3);
+	int index = 0, unread = 0, missed = 0;
+	int64 warpTicks = 0, start = getTickCount();
+	while (loader.Next(frame, &index))
+	{
+		if (!frame.data)
+		{
+			printf(" No image data in %s \n", inputs[index].c_str());
+			++unread;
+			continue;
+		}
 
-	Mat Scale = (Mat_<float>(3, 3) << targetColSize, 0, 0, 0, targetRowSize, 0, 0, 0, 1);
+		int64 warpStart = getTickCount();
+		Point2f found[4];
+		if (corners.empty())
+		{
+			if (!detector.Detect(frame, found))
+			{
+				printf(" No court found in %s \n", inputs[index].c_str());
+				warpTicks += getTickCount() - warpStart;
+				++missed;
+				continue;
+			}
+			gDistortPts.assign(found, found + 4);
+		}
 
-	Mat ret = C * Scale;
+		Rectify(frame, outputImg, backend, cache, corners.empty() ? &temporal : 0);
+		warpTicks += getTickCount() - warpStart;
+		writer.Write(outputs[index], outputImg, done);
+	}
+	writer.Flush();
 
-	return ret;
+	double seconds = (getTickCount() - start) / getTickFrequency();
+	double msPerTick = 1000. / getTickFrequency();
+	FrameLoaderStats loaderStats = loader.GetStats();
+	FrameWriterStats writerStats = writer.GetStats();
+	int written = (int)(writerStats.frames - writerStats.failures);
+	printf("%d of %d frames in %.2f s: %.1f fps, %.1f output MP/s\n", written, (int)inputs.size(), seconds,
+		written / seconds, (double)size.area() * written / seconds * 1e-6);
+	printf("  %s %.1f ms, queueing outputs %.1f ms (%.1f ms of it waiting for the writer), waiting on %d decode threads %.1f ms\n",
+		corners.empty() ? "detect and warp" : "warp", warpTicks * msPerTick,
+		(writerStats.copyTicks + writerStats.stallTicks) * msPerTick, writerStats.stallTicks * msPerTick, decoders,
+		loaderStats.consumerStalls * msPerTick);
+	printf("  %d encode threads: encode %.1f ms, disk %.1f ms, %.1f MB written at %.1f MB/s\n", writerParams.threads,
+		writerStats.encodeTicks * msPerTick, writerStats.diskTicks * msPerTick, writerStats.bytes * 1e-6,
+		writerStats.BytesPerSecond() * 1e-6);
+	PrintMapReuse(temporal);
+	if (unread + missed + writerStats.failures)
+	{
+		printf("  %d unreadable, %d without a court, %d not written\n", unread, missed, (int)writerStats.failures);
+	}
+	return unread + missed + (int)writerStats.failures;
 }
 
-// Using home made transform function
-void ProcessImg(Mat& src, Mat& dest)
+// Rectifies inputs like RunHeadless, but publishes the outputs into the
+// shared memory frame ring name of slots frames for another process
+// (shm_consumer) instead of writing files. Each output is warped straight
+// into its ring slot, no copy. A frame finding the ring full is dropped
+// rather than waiting for the consumer. Returns the number of inputs that
+// were not published.
+static int RunShm(const vector<string>& inputs, const vector<Point2f>& corners, Size size, int backend, int decoders,
+	const string& name, int slots)
 {
-	// TODO:
-	Mat_<Vec3b> _src = src;
-	Mat_<Vec3b> _dest = dest;
+	ShmRingWriter ring;
+	if (!ring.Create(name, size, CV_8UC3, slots))
+	{
+		printf(" Could not create the frame ring %s \n", name.c_str());
+		return (int)inputs.size();
+	}
+
+	FrameLoaderParams loaderParams;
+	loaderParams.threads = decoders;
+	FrameLoader loader(inputs, loaderParams);
+	CourtDetector detector;
+	WarpMapCache cache;
+	TemporalWarp temporal;
 
-	Mat transformationMatrix = GetProjMat(&gDistortPts[0], TARGET_ROW, TARGET_COL);
+	if (!corners.empty())
+	{
+		gDistortPts = corners;
+	}
+	InitOutputPts(size);
 
-	for (int i = 0; i < src.rows; ++i)
+	Mat frame, slot;
+	int index = 0, unread = 0, missed = 0;
+	int64 warpTicks = 0, start = getTickCount();
+	while (loader.Next(frame, &index))
 	{
-		for (int j = 0; j < src.cols; ++j)
+		if (!frame.data)
+		{
+			printf(" No image data in %s \n", inputs[index].c_str());
+			++unread;
+			continue;
+		}
+
+		// detect even when the frame is dropped, the tracking needs every frame
+		int64 warpStart = getTickCount();
+		Point2f found[4];
+		if (corners.empty())
 		{
-			int x = i, y = j;
-
-			Mat orign = Mat(Point3f(i, j, 1));
-			Mat ret = transformationMatrix * orign;
-			Point3f retPts(ret);
-			x = retPts.x / retPts.z;
-			y = retPts.y / retPts.z;
-			if (x >= 0 && x < dest.rows && y >= 0 && y < dest.cols)
+			if (!detector.Detect(frame, found))
 			{
-				_dest(x, y) = _src(i, j);
+				printf(" No court found in %s \n", inputs[index].c_str());
+				warpTicks += getTickCount() - warpStart;
+				++missed;
+				continue;
 			}
+			gDistortPts.assign(found, found + 4);
+		}
+
+		if (ring.Acquire(slot))
+		{
+			Rectify(frame, slot, backend, cache, corners.empty() ? &temporal : 0);
+			ring.Publish();
 		}
+		warpTicks += getTickCount() - warpStart;
+	}
+
+	double seconds = (getTickCount() - start) / getTickFrequency();
+	ShmRingWriterStats ringStats = ring.GetStats();
+	int published = (int)ringStats.published;
+	printf("%d of %d frames published to %s in %.2f s: %.1f fps, %.1f output MP/s\n", published, (int)inputs.size(),
+		name.c_str(), seconds, published / seconds, (double)size.area() * published / seconds * 1e-6);
+	printf("  %s %.1f ms, waiting on %d decode threads %.1f ms\n", corners.empty() ? "detect and warp" : "warp",
+		warpTicks * 1000. / getTickFrequency(), decoders, loader.GetStats().consumerStalls * 1000. / getTickFrequency());
+	PrintMapReuse(temporal);
+	if (unread + missed + ringStats.drops)
+	{
+		printf("  %d unreadable, %d without a court, %d dropped on a full ring\n", unread, missed, (int)ringStats.drops);
 	}
+	return unread + missed + (int)ringStats.drops;
 }
 
-// Using OpenCV built-in
-void ProcessImgCV(Mat& src, Mat& dest)
+// Rectifies every frame of the input video into the output one, decode, warp
+// and encode overlapping (RectifyVideo). Frames where CourtDetector loses
+// the court keep the corners of the frame before, or are black before the
+// court was first found. Prints the throughput and what bounds it.
+static int RunVideo(const string& input, const string& output, const vector<Point2f>& corners, Size size, int backend,
+	const VideoPipelineParams& params)
 {
-	//TODO:
-	Mat transformationMatrix = getPerspectiveTransform(&gDistortPts[0], &gTargetPts[0]);
-	warpPerspective(src, dest, transformationMatrix, dest.size(), CV_INTER_LINEAR, BORDER_ISOLATED);
+	CourtDetector detector;
+	WarpMapCache cache;
+	TemporalWarp temporal;
+	int missed = 0;
+	gDistortPts = corners;
+	InitOutputPts(size);
+
+	VideoPipelineStats stats;
+	bool ok = RectifyVideo(input, output, size, [&](Mat& src, Mat& dest)
+	{
+		Point2f found[4];
+		if (corners.empty() && detector.Detect(src, found))
+		{
+			gDistortPts.assign(found, found + 4);
+		}
+		else if (corners.empty())
+		{
+			++missed;
+		}
+
+		if (gDistortPts.empty())
+		{
+			dest = Scalar::all(0);
+			return;
+		}
+		Rectify(src, dest, backend, cache, corners.empty() ? &temporal : 0);
+	}, params, &stats);
+	if (!ok)
+	{
+		printf(" Could not open %s or create %s \n ", input.c_str(), output.c_str());
+		return -1;
+	}
+
+	printf("%lld frames in %.2f s: %.1f fps end to end\n", (long long)stats.frames,
+		stats.ticks / getTickFrequency(), stats.Fps());
+	printf("  busy: decode %.0f%%, %s %.0f%%, encode %.0f%%\n", stats.Busy(stats.decodeTicks) * 100.,
+		corners.empty() ? "detect and warp" : "warp", stats.Busy(stats.warpTicks) * 100.,
+		stats.Busy(stats.encodeTicks) * 100.);
+	PrintMapReuse(temporal);
+	if (missed)
+	{
+		printf("  %d frames without a court\n", missed);
+	}
+	return 0;
 }
 
 int main(int argc, char** argv)
 {
-	const char* inputPath = "basketball-court.ppm";
-	const char* outputPath = "out.bmp";
+	const char* keys =
+		"{help h usage ? |                      | print this message }"
+		"{@input         | basketball-court.ppm | input image, or with --headless a quoted glob of them }"
+		"{output o       | out.bmp              | output image; for a glob, the directory the outputs go to }"
+		"{format         | bmp                  | --headless: bmp, png, jpg or raw (PPM/PGM) outputs; a single output file takes the format of its extension }"
+		"{png_level      | 1                    | --headless png: compression, 0 (fastest) to 9 (smallest) }"
+		"{jpeg_quality   | 95                   | --headless jpg: quality, 0 to 100 }"
+		"{encoders       | 2                    | --headless: threads encoding and writing outputs }"
+		"{headless       |                      | no windows: rectify and write every input, print the throughput }"
+		"{corners        |                      | x,y,x,y,x,y,x,y of the court (left bottom, left top, right top, right bottom), a convex quad, found by CourtDetector when empty }"
+		"{size           | 940x500              | output width x height }"
+		"{backend        | engine               | engine (ProcessImg), cache (warp engine with a map cache, for fixed --corners) or opencv (ProcessImgCV) }"
+		"{threads        | 0                    | warp threads, 0 for OpenCV's default }"
+		"{decoders       | 2                    | --headless: threads decoding inputs ahead }"
+		"{shm            |                      | --headless: publish the outputs into the shared memory frame ring of this name rather than files, for shm_consumer }"
+		"{shm_slots      | 4                    | --shm: frames in the ring }"
+		"{video          |                      | @input is a video, every frame is rectified into the --output video, no windows }"
+		"{fourcc         | MJPG                 | --video: codec of the output }"
+		"{depth          | 4                    | --video: frames in flight between decode, warp and encode }";
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("Rectifies the court of a frame, in a window or headless over many frames");
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	string inputPath = parser.get<string>(0);
+	string outputPath = parser.get<string>("output");
+	FrameWriterParams writerParams;
+	writerParams.format = ParseFormat(parser.get<string>("format"));
+	writerParams.pngCompression = parser.get<int>("png_level");
+	writerParams.jpegQuality = parser.get<int>("jpeg_quality");
+	writerParams.threads = parser.get<int>("encoders");
+	bool headless = parser.has("headless");
+	string cornersText = parser.get<string>("corners");
+	string sizeText = parser.get<string>("size");
+	string backendName = parser.get<string>("backend");
+	int threads = parser.get<int>("threads");
+	int decoders = parser.get<int>("decoders");
+	string shmName = parser.get<string>("shm");
+	int shmSlots = parser.get<int>("shm_slots");
+	bool video = parser.has("video");
+	string fourcc = parser.get<string>("fourcc");
+	VideoPipelineParams videoParams;
+	videoParams.depth = parser.get<int>("depth");
+
+	vector<Point2f> corners;
+	Size size;
+	int backend = backendName == "engine" ? BACKEND_ENGINE : backendName == "cache" ? BACKEND_CACHE
+		: backendName == "opencv" ? BACKEND_OPENCV : -1;
+	if (!parser.check() || (!cornersText.empty() && !ParseCorners(cornersText, corners)) || !ParseSize(sizeText, size)
+		|| backend < 0 || threads < 0 || decoders < 1 || shmSlots < 1 || fourcc.size() != 4 || videoParams.depth < 1
+		|| writerParams.format < 0 || writerParams.pngCompression < 0 || writerParams.pngCompression > 9
+		|| writerParams.jpegQuality < 0 || writerParams.jpegQuality > 100 || writerParams.threads < 1)
+	{
+		parser.printErrors();
+		parser.printMessage();
+		return -1;
+	}
+	if (threads > 0)
+	{
+		setNumThreads(threads);
+	}
+
+	if (video)
+	{
+		videoParams.fourcc = VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
+		return RunVideo(inputPath, outputPath, corners, size, backend, videoParams);
+	}
+
+	// a glob is written into a directory, under the names of its inputs
+	vector<String> matches;
+	glob(inputPath, matches, false);
+	bool pattern = inputPath.find_first_of("*?") != string::npos;
+	if (matches.empty())
+	{
+		printf(" No input matches %s \n ", inputPath.c_str());
+		return -1;
+	}
+	vector<string> inputs(matches.begin(), matches.end());
+	vector<string> outputs(1, outputPath);
+	if (pattern || inputs.size() > 1)
+	{
+		outputs.clear();
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			outputs.push_back(OutputName(inputs[i], outputPath, FrameWriter::Extension(writerParams.format)));
+		}
+	}
+	else if (outputPath.find_last_of('.') != string::npos)
+	{
+		int extensionFormat = ParseFormat(outputPath.substr(outputPath.find_last_of('.') + 1));
+		writerParams.format = extensionFormat >= 0 ? extensionFormat : writerParams.format;
+	}
+
+	if (headless && !shmName.empty())
+	{
+		return RunShm(inputs, corners, size, backend, decoders, shmName, shmSlots) ? 1 : 0;
+	}
+	if (headless)
+	{
+		return RunHeadless(inputs, outputs, corners, size, backend, decoders, writerParams) ? 1 : 0;
+	}
 
 	//Read Img
 	Mat inputImg;
-	inputImg = imread(inputPath, -1);
+	inputImg = imread(inputs[0], -1);
 
 	if (!inputImg.data)
 	{
@@ -115,34 +443,37 @@ int main(int argc, char** argv)
 	}
 
 	// Init Mapping Points
-	InitPickPoints();
-	InitOutputPts();
+	if (!corners.empty())
+	{
+		gDistortPts = corners;
+	}
+	else if (!InitPickPoints(inputImg))
+	{
+		printf(" No court found \n ");
+		return -1;
+	}
+	InitOutputPts(size);
 
 	// Draw Clip 
-	vector<Point> not_a_rect_shape;
-	not_a_rect_shape.push_back(Point(22, 193)); // left bottom
-	not_a_rect_shape.push_back(Point(246, 50)); // left top
-	not_a_rect_shape.push_back(Point(402, 74)); // right top
-	not_a_rect_shape.push_back(Point(278, 279)); // right bottom
-
-	const Point* point = &not_a_rect_shape[0];
-	int n = (int)not_a_rect_shape.size();
+	vector<Point> clip(gDistortPts.begin(), gDistortPts.end());
+
+	const Point* point = &clip[0];
+	int n = (int)clip.size();
 	polylines(inputImg, &point, &n, 1, true, Scalar(0, 255, 0), 3, CV_AA);
 	namedWindow("Clip", CV_WINDOW_AUTOSIZE);
 	imshow("Clip", inputImg);
 
 	// Where you output
 	Mat outputImg;
-	outputImg = Mat::zeros(TARGET_ROW, TARGET_COL, CV_8UC3);
+	outputImg = Mat::zeros(size, CV_8UC3);
 	//outputImg = Mat::zeros(1, 1, CV_8UC3);
 
 	// Applay Processing Function
-	// TODO
-	//ProcessImgCV(inputImg, outputImg);
-	ProcessImg(inputImg, outputImg);
+	WarpMapCache cache;
+	Rectify(inputImg, outputImg, backend, cache, 0);
 
-	namedWindow(outputPath, CV_WINDOW_AUTOSIZE);
-	imshow(outputPath, outputImg);
+	namedWindow(outputs[0], CV_WINDOW_AUTOSIZE);
+	imshow(outputs[0], outputImg);
 	std::cout << "Press \'s\' to save, \'Esc'\ to close the program.\n";
 	int key = waitKey(0);
 
@@ -155,7 +486,7 @@ int main(int argc, char** argv)
 	{
 		// Write Output
 		bool succ = false;
-		succ = imwrite(outputPath, outputImg);
+		succ = imwrite(outputs[0], outputImg);
 		if (!succ)
 		{
 			printf(" Image writing fialed \n ");
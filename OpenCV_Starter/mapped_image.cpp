@@ -0,0 +1,236 @@
+#include "mapped_image.h"
+
+#include <cctype>                          // isdigit, isspace
+#include <climits>                         // INT_MAX
+#include <cstdio>                          // sprintf
+#include <cstring>                         // memcpy
+
+#ifdef _WIN32
+#include <windows.h>                       // CreateFileMapping(), MapViewOfFile()
+#else
+#include <fcntl.h>                         // open()
+#include <sys/mman.h>                      // mmap(), munmap()
+#include <sys/stat.h>                      // fstat()
+#include <unistd.h>                        // close(), ftruncate()
+#endif
+
+using namespace cv;
+
+// Parses the header of a binary PGM or PPM held in data[0, size): returns the
+// offset of its pixels, or 0 when it is not one with 8-bit samples or the
+// pixels do not fit in size
+static size_t ParseHeader(const uchar* data, size_t size, int& width, int& height, int& channels)
+{
+	if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+	{
+		return 0;
+	}
+	channels = data[1] == '6' ? 3 : 1;
+
+	// width, height and maxval, separated by whitespace and comments
+	size_t pos = 2;
+	int values[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		while (pos < size && (isspace(data[pos]) || data[pos] == '#'))
+		{
+			if (data[pos] == '#')
+			{
+				while (pos < size && data[pos] != '\n')
+				{
+					++pos;
+				}
+				continue;
+			}
+			++pos;
+		}
+
+		int64 value = 0;
+		size_t start = pos;
+		while (pos < size && isdigit(data[pos]) && value <= INT_MAX)
+		{
+			value = value * 10 + (data[pos++] - '0');
+		}
+		if (pos == start || value <= 0 || value > INT_MAX)
+		{
+			return 0;
+		}
+		values[i] = (int)value;
+	}
+
+	// a single whitespace character ends the header
+	if (pos >= size || !isspace(data[pos]) || values[2] != 255)
+	{
+		return 0;
+	}
+	++pos;
+
+	width = values[0];
+	height = values[1];
+	// divided rather than multiplied, width * height * channels may not fit in a size_t
+	if ((size - pos) / channels / width < (size_t)height)
+	{
+		return 0;
+	}
+	return pos;
+}
+
+MappedImage::MappedImage()
+	: base(0), size(0),
+#ifdef _WIN32
+	file(INVALID_HANDLE_VALUE), mapping(0)
+#else
+	fd(-1)
+#endif
+{
+}
+
+MappedImage::~MappedImage()
+{
+	Close();
+}
+
+// Maps path whole, or sized to size bytes when writable (the file is created
+// or truncated); a read only mapping is copy on write, so drawing into an
+// opened image never reaches the file
+bool MappedImage::Map(const std::string& path, size_t size, bool writable)
+{
+	Close();
+
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, 0,
+		writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	if (!writable)
+	{
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			Close();
+			return false;
+		}
+		size = (size_t)fileSize.QuadPart;
+	}
+	if (size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	unsigned long long mappingSize = writable ? size : 0;
+	mapping = CreateFileMappingA(file, 0, writable ? PAGE_READWRITE : PAGE_WRITECOPY,
+		(DWORD)(mappingSize >> 32), (DWORD)mappingSize, 0);
+	void* view = mapping ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, size) : 0;
+	if (!view)
+	{
+		Close();
+		return false;
+	}
+#else
+	fd = open(path.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	if (!writable)
+	{
+		struct stat status;
+		if (fstat(fd, &status) != 0)
+		{
+			Close();
+			return false;
+		}
+		size = (size_t)status.st_size;
+	}
+	if (size == 0 || (writable && ftruncate(fd, (off_t)size) != 0))
+	{
+		Close();
+		return false;
+	}
+
+	void* view = mmap(0, size, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+#endif
+
+	base = (uchar*)view;
+	this->size = size;
+	return true;
+}
+
+bool MappedImage::Open(const std::string& path)
+{
+	if (!Map(path, 0, false))
+	{
+		return false;
+	}
+
+	int width, height, channels;
+	size_t offset = ParseHeader(base, size, width, height, channels);
+	if (!offset)
+	{
+		Close();
+		return false;
+	}
+	image = Mat(height, width, CV_8UC(channels), base + offset);
+	return true;
+}
+
+bool MappedImage::Create(const std::string& path, Size imageSize, int type)
+{
+	CV_Assert((type == CV_8UC1 || type == CV_8UC3) && imageSize.width > 0 && imageSize.height > 0);
+
+	char header[64];
+	int headerSize = sprintf(header, "P%d\n%d %d\n255\n", type == CV_8UC3 ? 6 : 5, imageSize.width, imageSize.height);
+	size_t pixelBytes = (size_t)imageSize.width * imageSize.height * CV_ELEM_SIZE(type);
+	CV_Assert(pixelBytes / imageSize.height / CV_ELEM_SIZE(type) == (size_t)imageSize.width);
+	if (!Map(path, headerSize + pixelBytes, true))
+	{
+		return false;
+	}
+
+	memcpy(base, header, headerSize);
+	image = Mat(imageSize, type, base + headerSize);
+	return true;
+}
+
+void MappedImage::Close()
+{
+	image.release();
+
+#ifdef _WIN32
+	if (base)
+	{
+		UnmapViewOfFile(base);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (base)
+	{
+		munmap(base, size);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	fd = -1;
+#endif
+
+	base = 0;
+	size = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef MAPPED_IMAGE_H
+#define MAPPED_IMAGE_H
+
+#include <string>                          // std::string
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+// A binary PPM (P6) or PGM (P5) file with 8-bit samples, memory mapped.
+//
+// Open maps the file read only, parses the header and points Image() straight
+// into the mapping: no decode and no copy, the pages are read in as the
+// pixels are touched. Create sizes a new file for an image, maps it writable
+// and writes the header; whatever is drawn or warped into Image() lands in
+// the file, the kernel writes it back.
+// Channels are in file order, RGB for P6, where imread gives BGR. The warps
+// do not care and Create writes them back in the same order.
+// Image() is valid until Close, the next Open or Create, or destruction.
+class MappedImage
+{
+public:
+	MappedImage();
+	~MappedImage();
+
+	// Returns false when path cannot be mapped or is not a P5/P6 file with
+	// maxval 255
+	bool Open(const std::string& path);
+
+	// type is CV_8UC1 (P5) or CV_8UC3 (P6), an existing file is replaced.
+	// Returns false when the file cannot be created or mapped.
+	bool Create(const std::string& path, cv::Size size, int type);
+
+	void Close();
+
+	const cv::Mat& Image() const { return image; }
+	cv::Mat& Image() { return image; }
+
+private:
+	bool Map(const std::string& path, size_t size, bool writable);
+
+	MappedImage(const MappedImage&);
+	MappedImage& operator=(const MappedImage&);
+
+	uchar* base;    // start of the mapping
+	size_t size;    // of the mapping
+#ifdef _WIN32
+	void* file;     // HANDLE of the file and of its mapping
+	void* mapping;
+#else
+	int fd;
+#endif
+	cv::Mat image;
+};
+
+#endif
@@ -0,0 +1,194 @@
+// Consumer of the shared memory frame ring the rectifier publishes into with
+// --shm. Maps the frames where they lie, no copy, and reports the latency from
+// publish to acquire and the frames the producer dropped on a full ring.
+// --loopback runs a producer thread in this process too, so the ring can be
+// measured without the rectifier.
+#include <algorithm>                       // std::sort
+#include <atomic>                          // std::atomic
+#include <chrono>                          // std::chrono::microseconds
+#include <cstdio>                          // printf, sscanf
+#include <string>                          // std::string
+#include <thread>                          // std::thread
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+#include <opencv2/core/utility.hpp>        // cv::CommandLineParser
+#include "shm_ring.h"                      // ShmRingReader, ShmRingWriter
+
+using namespace std;
+using namespace cv;
+
+#define LOOPBACK_NAME "court_loopback" // ring of --loopback when none is named
+
+// Publishes frames frames of size into name, each filled with its sequence
+// number, every periodUs microseconds or as fast as the ring takes them.
+// ready is set once the ring exists, done once the last frame is published;
+// the ring is unlinked then but stays mapped for the consumer.
+static void Produce(const string& name, Size size, int slots, int frames, int periodUs, atomic<bool>* ready,
+	atomic<bool>* done, ShmRingWriterStats* stats)
+{
+	ShmRingWriter writer;
+	bool created = writer.Create(name, size, CV_8UC3, slots);
+	*ready = true;
+	if (!created)
+	{
+		*done = true;
+		return;
+	}
+
+	Mat slot;
+	for (int i = 0; i < frames; ++i)
+	{
+		if (writer.Acquire(slot))
+		{
+			slot.setTo(Scalar::all(i & 0xff));
+			writer.Publish();
+		}
+		if (periodUs)
+		{
+			this_thread::sleep_for(chrono::microseconds(periodUs));
+		}
+	}
+	*stats = writer.GetStats();
+	*done = true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* keys =
+		"{help h usage ? |         | print this message }"
+		"{@ring          |         | name of the ring, as given to the rectifier's --shm }"
+		"{frames         | 0       | stop after this many frames, 0 to run until the producer goes quiet }"
+		"{timeout        | 2000    | give up after this long without the ring or a frame, in ms }"
+		"{hold           | 0       | keep each frame this long before releasing it, in us, to act as a slow consumer }"
+		"{loopback       |         | also run a producer in this process }"
+		"{size           | 940x500 | frame size of the loopback producer }"
+		"{slots          | 4       | ring slots of the loopback producer }"
+		"{period         | 1000    | loopback producer publishes every this many us, 0 as fast as it can }";
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("Reads rectified frames from a shared memory ring and reports their latency");
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	string name = parser.get<string>(0);
+	int frames = parser.get<int>("frames");
+	int timeout = parser.get<int>("timeout");
+	int holdUs = parser.get<int>("hold");
+	bool loopback = parser.has("loopback");
+	string sizeArg = parser.get<string>("size");
+	int slots = parser.get<int>("slots");
+	int periodUs = parser.get<int>("period");
+	Size size;
+	if (!parser.check() || (name.empty() && !loopback) || frames < 0 || timeout < 1 || holdUs < 0 || slots < 1
+		|| periodUs < 0 || sscanf(sizeArg.c_str(), "%dx%d", &size.width, &size.height) != 2
+		|| size.width < 1 || size.height < 1)
+	{
+		parser.printErrors();
+		parser.printMessage();
+		return -1;
+	}
+	if (name.empty())
+	{
+		name = LOOPBACK_NAME;
+	}
+
+	thread producer;
+	atomic<bool> ready(false), produced(false);
+	ShmRingWriterStats producerStats;
+	if (loopback)
+	{
+		producer = thread(Produce, name, size, slots, frames ? frames : 1000, periodUs, &ready, &produced,
+			&producerStats);
+		while (!ready)
+		{
+			this_thread::yield();
+		}
+	}
+
+	// the producer may not have created the ring yet
+	ShmRingReader reader;
+	int64 deadline = getTickCount() + (int64)(timeout * getTickFrequency() / 1000.);
+	bool opened;
+	while (!(opened = reader.Open(name)) && getTickCount() < deadline)
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	if (!opened)
+	{
+		printf(" No frame ring %s \n ", name.c_str());
+		if (producer.joinable())
+		{
+			producer.join();
+		}
+		return -1;
+	}
+
+	// the first frame only tells where the producer is, it may have waited
+	// in the ring for long
+	vector<double> latencyUs;
+	int64 gaps = 0, dropped = 0, mismatches = 0, first = 0, last = 0;
+	uint64 expected = 0;
+	Mat frame;
+	ShmFrameInfo info;
+	for (int received = 0; !frames || received < frames; ++received)
+	{
+		if ((produced && !reader.Pending()) || !reader.Wait(frame, &info, timeout))
+		{
+			break;
+		}
+		int64 now = getTickCount();
+		if (received)
+		{
+			latencyUs.push_back((now - info.publishTicks) * 1e6 / getTickFrequency());
+			if (info.sequence != expected)
+			{
+				++gaps;
+				dropped += (int64)(info.sequence - expected);
+			}
+		}
+		else
+		{
+			first = now;
+		}
+		last = now;
+		expected = info.sequence + 1;
+
+		// the loopback producer fills each frame with its sequence number
+		if (loopback && (frame.at<Vec3b>(0, 0)[0] != (info.sequence & 0xff)
+			|| frame.at<Vec3b>(frame.rows - 1, frame.cols - 1)[2] != (info.sequence & 0xff)))
+		{
+			++mismatches;
+		}
+
+		if (holdUs)
+		{
+			this_thread::sleep_for(chrono::microseconds(holdUs));
+		}
+		reader.Release();
+	}
+	if (producer.joinable())
+	{
+		producer.join();
+	}
+
+	if (latencyUs.empty())
+	{
+		printf(" No frames from ring %s \n ", name.c_str());
+		return -1;
+	}
+	sort(latencyUs.begin(), latencyUs.end());
+	double seconds = (last - first) / getTickFrequency();
+	printf("Ring %s, %dx%d type %d, %d frames in %.2f s, %.1f fps\n", name.c_str(), frame.cols, frame.rows,
+		frame.type(), (int)latencyUs.size() + 1, seconds, seconds > 0 ? latencyUs.size() / seconds : 0.);
+	printf("  latency  min %8.1f  median %8.1f  p99 %8.1f  max %8.1f us\n", latencyUs[0],
+		latencyUs[latencyUs.size() / 2], latencyUs[min(latencyUs.size() - 1, (size_t)(latencyUs.size() * 0.99))],
+		latencyUs.back());
+	printf("  dropped  %lld frames in %lld gaps\n", (long long)dropped, (long long)gaps);
+	if (loopback)
+	{
+		printf("  producer published %lld, dropped %lld; %lld frames with wrong pixels\n",
+			(long long)producerStats.published, (long long)producerStats.drops, (long long)mismatches);
+	}
+	return mismatches ? -1 : 0;
+}
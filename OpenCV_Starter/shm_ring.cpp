@@ -0,0 +1,353 @@
+#include "shm_ring.h"
+
+#include <chrono>                          // std::chrono::microseconds
+#include <cstring>                         // memcpy, memcmp
+#include <new>                             // placement new
+#include <thread>                          // std::this_thread
+
+#ifdef _WIN32
+#include <windows.h>                       // CreateFileMapping(), MapViewOfFile()
+#else
+#include <fcntl.h>                         // O_CREAT
+#include <sys/mman.h>                      // shm_open(), mmap()
+#include <sys/stat.h>                      // fstat()
+#include <unistd.h>                        // close(), ftruncate()
+#endif
+
+using namespace std;
+using namespace cv;
+
+#define WAIT_SPIN_TRIES 64 // ShmRingReader::Wait yields this many times before it starts sleeping
+#define WAIT_SLEEP_US 50   // then naps this long between tries
+
+CV_StaticAssert(sizeof(ShmRingHeader) == 3 * SHM_RING_ALIGN, "the ring header layout is fixed");
+CV_StaticAssert(sizeof(std::atomic<uint64>) == sizeof(uint64), "the ring indices must be plain 64-bit words");
+CV_StaticAssert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring indices must be lock free to be shared between processes");
+
+static size_t AlignUp(size_t size)
+{
+	return (size + SHM_RING_ALIGN - 1) & ~(size_t)(SHM_RING_ALIGN - 1);
+}
+
+// shm_open wants a name starting with its one slash
+static string RegionName(const string& name)
+{
+#ifdef _WIN32
+	return name;
+#else
+	return name.empty() || name[0] != '/' ? "/" + name : name;
+#endif
+}
+
+ShmRegion::ShmRegion()
+	: base(0), size(0),
+#ifdef _WIN32
+	mapping(0)
+#else
+	fd(-1)
+#endif
+{
+}
+
+ShmRegion::~ShmRegion()
+{
+	Close();
+}
+
+bool ShmRegion::Create(const string& name, size_t size)
+{
+	Close();
+	string path = RegionName(name);
+
+#ifdef _WIN32
+	unsigned long long mappingSize = size;
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)(mappingSize >> 32),
+		(DWORD)mappingSize, path.c_str());
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : 0;
+	if (!view)
+	{
+		Close();
+		return false;
+	}
+#else
+	shm_unlink(path.c_str());
+	fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		return false;
+	}
+	created = path;
+	void* view = ftruncate(fd, (off_t)size) == 0 ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+#endif
+
+	base = (uchar*)view;
+	this->size = size;
+	return true;
+}
+
+bool ShmRegion::Open(const string& name)
+{
+	Close();
+	string path = RegionName(name);
+
+#ifdef _WIN32
+	mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : 0;
+	MEMORY_BASIC_INFORMATION info;
+	if (!view || !VirtualQuery(view, &info, sizeof(info)))
+	{
+		if (view)
+		{
+			UnmapViewOfFile(view);
+		}
+		Close();
+		return false;
+	}
+	size_t mappedSize = info.RegionSize;
+#else
+	fd = shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat status;
+	size_t mappedSize = fstat(fd, &status) == 0 ? (size_t)status.st_size : 0;
+	void* view = mappedSize ? mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+#endif
+
+	base = (uchar*)view;
+	size = mappedSize;
+	return true;
+}
+
+void ShmRegion::Close()
+{
+#ifdef _WIN32
+	if (base)
+	{
+		UnmapViewOfFile(base);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	mapping = 0;
+#else
+	if (base)
+	{
+		munmap(base, size);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	if (!created.empty())
+	{
+		shm_unlink(created.c_str());
+	}
+	fd = -1;
+#endif
+
+	created.clear();
+	base = 0;
+	size = 0;
+}
+
+ShmRingWriterStats::ShmRingWriterStats()
+	: published(0), drops(0)
+{
+}
+
+ShmRingWriter::ShmRingWriter()
+	: header(0), slot(0)
+{
+}
+
+bool ShmRingWriter::Create(const string& name, Size size, int type, int slots)
+{
+	CV_Assert(size.width > 0 && size.height > 0 && slots >= 1);
+	Close();
+
+	size_t step = AlignUp((size_t)size.width * CV_ELEM_SIZE(type));
+	size_t slotBytes = AlignUp(sizeof(ShmSlotHeader)) + step * size.height;
+	size_t slotOffset = sizeof(ShmRingHeader);
+	if (!region.Create(name, slotOffset + slotBytes * slots))
+	{
+		return false;
+	}
+
+	// a new region comes zeroed; the magic goes in last, a reader opening the
+	// ring meanwhile sees no ring yet
+	header = (ShmRingHeader*)region.Data();
+	new (&header->written) std::atomic<uint64>(0);
+	new (&header->read) std::atomic<uint64>(0);
+	header->step = step;
+	header->slotOffset = slotOffset;
+	header->slotBytes = slotBytes;
+	header->version = SHM_RING_VERSION;
+	header->width = size.width;
+	header->height = size.height;
+	header->type = type;
+	header->slots = slots;
+	atomic_thread_fence(memory_order_release);
+	memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+
+	stats = ShmRingWriterStats();
+	return true;
+}
+
+void ShmRingWriter::Close()
+{
+	region.Close();
+	header = 0;
+	slot = 0;
+}
+
+bool ShmRingWriter::Acquire(Mat& frame)
+{
+	CV_Assert(header);
+
+	uint64 written = header->written.load(memory_order_relaxed);
+	if (written - header->read.load(memory_order_acquire) >= (uint64)header->slots)
+	{
+		++stats.drops;
+		slot = 0;
+		return false;
+	}
+
+	slot = region.Data() + header->slotOffset + header->slotBytes * (written % header->slots);
+	frame = Mat(header->height, header->width, header->type, slot + AlignUp(sizeof(ShmSlotHeader)), header->step);
+	return true;
+}
+
+void ShmRingWriter::Publish()
+{
+	CV_Assert(slot);
+
+	ShmSlotHeader* slotHeader = (ShmSlotHeader*)slot;
+	slotHeader->sequence = (uint64)(stats.published + stats.drops);
+	slotHeader->publishTicks = getTickCount();
+	header->written.store(header->written.load(memory_order_relaxed) + 1, memory_order_release);
+	++stats.published;
+	slot = 0;
+}
+
+bool ShmRingWriter::Write(const Mat& frame)
+{
+	CV_Assert(header && frame.size() == Size(header->width, header->height) && frame.type() == header->type);
+
+	Mat slotFrame;
+	if (!Acquire(slotFrame))
+	{
+		return false;
+	}
+	frame.copyTo(slotFrame);
+	Publish();
+	return true;
+}
+
+ShmRingReader::ShmRingReader()
+	: header(0), acquired(false)
+{
+}
+
+bool ShmRingReader::Open(const string& name)
+{
+	Close();
+	if (!region.Open(name) || region.Size() < sizeof(ShmRingHeader))
+	{
+		Close();
+		return false;
+	}
+
+	// a ring only once the magic is in, and then the rest of the header too
+	ShmRingHeader* ring = (ShmRingHeader*)region.Data();
+	bool valid = memcmp(ring->magic, SHM_RING_MAGIC, sizeof(ring->magic)) == 0;
+	atomic_thread_fence(memory_order_acquire);
+	valid = valid && ring->version == SHM_RING_VERSION && ring->slots >= 1 && ring->width > 0 && ring->height > 0
+		&& ring->step >= (uint64)ring->width * CV_ELEM_SIZE(ring->type)
+		&& ring->slotBytes >= AlignUp(sizeof(ShmSlotHeader)) + ring->step * ring->height
+		&& ring->slotOffset + ring->slotBytes * ring->slots <= region.Size();
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	header = ring;
+	return true;
+}
+
+void ShmRingReader::Close()
+{
+	region.Close();
+	header = 0;
+	acquired = false;
+}
+
+bool ShmRingReader::Acquire(Mat& frame, ShmFrameInfo* info)
+{
+	CV_Assert(header);
+
+	uint64 read = header->read.load(memory_order_relaxed);
+	if (read == header->written.load(memory_order_acquire))
+	{
+		return false;
+	}
+
+	const uchar* slot = region.Data() + header->slotOffset + header->slotBytes * (read % header->slots);
+	const ShmSlotHeader* slotHeader = (const ShmSlotHeader*)slot;
+	frame = Mat(header->height, header->width, header->type, (uchar*)slot + AlignUp(sizeof(ShmSlotHeader)),
+		header->step);
+	if (info)
+	{
+		info->sequence = slotHeader->sequence;
+		info->publishTicks = slotHeader->publishTicks;
+	}
+	acquired = true;
+	return true;
+}
+
+bool ShmRingReader::Wait(Mat& frame, ShmFrameInfo* info, int timeoutMs)
+{
+	int64 deadline = getTickCount() + (int64)(timeoutMs * getTickFrequency() / 1000.);
+	for (int tries = 0; !Acquire(frame, info); ++tries)
+	{
+		if (getTickCount() > deadline)
+		{
+			return false;
+		}
+		if (tries < WAIT_SPIN_TRIES)
+		{
+			this_thread::yield();
+		}
+		else
+		{
+			this_thread::sleep_for(chrono::microseconds(WAIT_SLEEP_US));
+		}
+	}
+	return true;
+}
+
+void ShmRingReader::Release()
+{
+	CV_Assert(header && acquired);
+
+	header->read.store(header->read.load(memory_order_relaxed) + 1, memory_order_release);
+	acquired = false;
+}
+
+uint64 ShmRingReader::Pending() const
+{
+	CV_Assert(header);
+	return header->written.load(memory_order_acquire) - header->read.load(memory_order_relaxed);
+}
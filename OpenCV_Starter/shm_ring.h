@@ -0,0 +1,164 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>                          // std::atomic
+#include <string>                          // std::string
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+#define SHM_RING_MAGIC "CRTRING"           // ShmRingHeader::magic, with its terminating zero
+#define SHM_RING_VERSION 1
+#define SHM_RING_ALIGN 64                  // of the header fields shared by both sides, the slots and their rows
+
+// Layout of a frame ring in shared memory, fixed so a consumer in any
+// language can read it:
+//   ShmRingHeader, SHM_RING_ALIGN bytes aligned
+//   slots slots of slotBytes each from slotOffset, slot i holding frame
+//   number n when n % slots == i: a ShmSlotHeader padded to SHM_RING_ALIGN,
+//   then height rows of step bytes, width pixels of type each.
+// written and read count frames since the ring was created. Only the
+// producer stores written, only the consumer stores read, so neither takes
+// a lock: slots [read, written) hold published frames and the rest are the
+// producer's to fill. Both are 64-bit atomics, lock free on every platform
+// the ring is built for.
+struct ShmRingHeader
+{
+	char magic[8];                       // SHM_RING_MAGIC once the creator is done setting the header up
+	uint64 step;                         // bytes per row, a multiple of SHM_RING_ALIGN
+	uint64 slotOffset;                   // from the start of the mapping to slot 0
+	uint64 slotBytes;                    // from a slot to the next
+	int version;                         // SHM_RING_VERSION
+	int width;
+	int height;
+	int type;                            // cv::Mat type of the frames
+	int slots;
+	char padWritten[SHM_RING_ALIGN - 8 - 3 * sizeof(uint64) - 5 * sizeof(int)];
+	std::atomic<uint64> written;         // frames published, stored by the producer only
+	char padRead[SHM_RING_ALIGN - sizeof(uint64)];
+	std::atomic<uint64> read;            // frames released, stored by the consumer only
+	char padEnd[SHM_RING_ALIGN - sizeof(uint64)];
+};
+
+// Start of each slot
+struct ShmSlotHeader
+{
+	uint64 sequence;    // frame number among all the producer had, published or dropped, from 0
+	int64 publishTicks; // cv::getTickCount() when published; a monotonic clock shared by the processes of the machine
+};
+
+// A named shared memory region: shm_open and mmap, or a named file mapping
+// on Windows. Used by ShmRingWriter and ShmRingReader.
+class ShmRegion
+{
+public:
+	ShmRegion();
+	~ShmRegion();
+
+	// Creates name, replacing any region of that name, and maps size bytes.
+	// The name is unlinked again by Close, the mappings of others stay valid.
+	bool Create(const std::string& name, size_t size);
+
+	// Maps the existing region name whole
+	bool Open(const std::string& name);
+
+	void Close();
+
+	uchar* Data() const { return base; }
+	size_t Size() const { return size; }
+
+private:
+	ShmRegion(const ShmRegion&);
+	ShmRegion& operator=(const ShmRegion&);
+
+	uchar* base;
+	size_t size;
+	std::string created;  // name to unlink on Close, empty when opened
+#ifdef _WIN32
+	void* mapping;        // HANDLE of the file mapping
+#else
+	int fd;
+#endif
+};
+
+// Counters of a ShmRingWriter
+struct ShmRingWriterStats
+{
+	int64 published; // frames made visible to the consumer
+	int64 drops;     // frames refused because the consumer had not released a slot
+
+	ShmRingWriterStats();
+};
+
+// Producer side of a frame ring. The slots are handed out as Mats on the
+// shared memory itself, so a warp can write its output straight into the
+// ring: Acquire, warp into the Mat, Publish. Never blocks; when the consumer
+// lags a whole ring behind, Acquire fails and the frame is dropped rather
+// than stalling the rectifier. One producer thread per ring.
+class ShmRingWriter
+{
+public:
+	ShmRingWriter();
+
+	// Creates the ring name for slots frames of size and type
+	bool Create(const std::string& name, cv::Size size, int type, int slots);
+
+	void Close();
+
+	// slot gets the next free slot, false when the ring is full. The slot
+	// is the consumer's to read once published, do not touch it after.
+	bool Acquire(cv::Mat& slot);
+
+	// Publishes the slot of the last Acquire
+	void Publish();
+
+	// Acquire, copy frame in and Publish; false, the frame dropped, when full
+	bool Write(const cv::Mat& frame);
+
+	ShmRingWriterStats GetStats() const { return stats; }
+
+private:
+	ShmRegion region;
+	ShmRingHeader* header;
+	uchar* slot;                         // of the last Acquire, null when it failed or was published
+	ShmRingWriterStats stats;
+};
+
+// What a ShmRingReader knows of a frame besides its pixels
+struct ShmFrameInfo
+{
+	uint64 sequence;    // frame number among all the producer had, jumps where it dropped frames on a full ring
+	int64 publishTicks; // cv::getTickCount() when published
+};
+
+// Consumer side of a frame ring, from any process. Frames come out as Mats
+// pointing into the shared memory, no copy: Acquire, read the Mat, Release.
+// One consumer thread per ring.
+class ShmRingReader
+{
+public:
+	ShmRingReader();
+
+	// Maps the ring name, false when it does not exist or is not a ring
+	bool Open(const std::string& name);
+
+	void Close();
+
+	// frame gets the oldest published frame not released yet, false when
+	// there is none. It stays valid until Release.
+	bool Acquire(cv::Mat& frame, ShmFrameInfo* info = 0);
+
+	// Acquire, waiting up to timeoutMs for a frame to be published
+	bool Wait(cv::Mat& frame, ShmFrameInfo* info, int timeoutMs);
+
+	// Gives the frame of the last Acquire back to the producer
+	void Release();
+
+	// Published frames not released yet
+	uint64 Pending() const;
+
+private:
+	ShmRegion region;
+	ShmRingHeader* header;
+	bool acquired;                       // a frame is held since the last Acquire
+};
+
+#endif
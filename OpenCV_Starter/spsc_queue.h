@@ -0,0 +1,62 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>                          // std::atomic
+#include <cstddef>                         // size_t
+#include <vector>                          // std::vector
+
+// Bounded lock free queue between exactly one producer thread and one
+// consumer thread. Each side writes only its own index and reads the other
+// one, so neither ever takes a lock or waits on the other; TryPush and
+// TryPop fail instead when the queue is full or empty. The indices sit on
+// separate cache lines so the two threads do not bounce one line between
+// their cores on every item.
+template<typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(size_t capacity)
+		: items(capacity + 1), head(0), tail(0)
+	{
+	}
+
+	// Producer side, false when full
+	bool TryPush(const T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t next = t + 1 == items.size() ? 0 : t + 1;
+		if (next == head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		items[t] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, false when empty
+	bool TryPop(T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		item = items[h];
+		head.store(h + 1 == items.size() ? 0 : h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	SpscQueue(const SpscQueue&);
+	SpscQueue& operator=(const SpscQueue&);
+
+	std::vector<T> items;            // one slot more than the capacity, so full and empty differ
+	char padHead[64];
+	std::atomic<size_t> head;        // next item to pop, written by the consumer only
+	char padTail[64];
+	std::atomic<size_t> tail;        // next slot to push into, written by the producer only
+	char padEnd[64];
+};
+
+#endif
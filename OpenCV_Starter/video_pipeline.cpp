@@ -0,0 +1,181 @@
+#include "video_pipeline.h"
+
+#include <atomic>                          // std::atomic
+#include <chrono>                          // std::chrono::microseconds
+#include <thread>                          // std::thread
+#include <vector>                          // std::vector
+#include <opencv2/videoio/videoio.hpp>     // cv::VideoCapture, cv::VideoWriter
+#include "spsc_queue.h"                    // SpscQueue
+
+using namespace std;
+using namespace cv;
+
+#define DEFAULT_FPS 30.    // when neither the params nor the input give one
+#define SPIN_TRIES 64      // a waiting stage yields this many times before it starts sleeping
+#define SLEEP_US 100       // then naps this long between tries, leaving the cores to the warp
+
+VideoPipelineParams::VideoPipelineParams()
+	: depth(4), fourcc(VideoWriter::fourcc('M', 'J', 'P', 'G')), fps(0)
+{
+}
+
+VideoPipelineStats::VideoPipelineStats()
+	: frames(0), ticks(0), decodeTicks(0), warpTicks(0), encodeTicks(0)
+{
+}
+
+// One frame of the pool, recycled from stage to stage
+struct PipelineFrame
+{
+	Mat src;
+	Mat dest;
+};
+
+typedef SpscQueue<PipelineFrame*> FrameQueue;
+
+// Pops from queue, waiting while it is empty; false when stop was raised
+static bool WaitPop(FrameQueue& queue, PipelineFrame*& frame, const atomic<bool>& stop)
+{
+	for (int tries = 0; !queue.TryPop(frame); ++tries)
+	{
+		if (stop.load(memory_order_relaxed))
+		{
+			return false;
+		}
+		if (tries < SPIN_TRIES)
+		{
+			this_thread::yield();
+		}
+		else
+		{
+			this_thread::sleep_for(chrono::microseconds(SLEEP_US));
+		}
+	}
+	return true;
+}
+
+// Pushes into queue, waiting while it is full; false when stop was raised
+static bool WaitPush(FrameQueue& queue, PipelineFrame* frame, const atomic<bool>& stop)
+{
+	for (int tries = 0; !queue.TryPush(frame); ++tries)
+	{
+		if (stop.load(memory_order_relaxed))
+		{
+			return false;
+		}
+		if (tries < SPIN_TRIES)
+		{
+			this_thread::yield();
+		}
+		else
+		{
+			this_thread::sleep_for(chrono::microseconds(SLEEP_US));
+		}
+	}
+	return true;
+}
+
+// Reads frames into the free ones until the input ends, which it passes on
+// as a null frame
+static void DecodeStage(VideoCapture& capture, FrameQueue& free, FrameQueue& decoded, const atomic<bool>& stop,
+	int64& ticks)
+{
+	PipelineFrame* frame;
+	while (WaitPop(free, frame, stop))
+	{
+		int64 start = getTickCount();
+		bool ok = capture.read(frame->src) && frame->src.data;
+		ticks += getTickCount() - start;
+		if (!WaitPush(decoded, ok ? frame : 0, stop) || !ok)
+		{
+			return;
+		}
+	}
+}
+
+// Writes the warped frames in order and gives them back, up to the null one
+static void EncodeStage(VideoWriter& writer, FrameQueue& warped, FrameQueue& free, const atomic<bool>& stop,
+	int64& ticks, int64& frames)
+{
+	PipelineFrame* frame;
+	while (WaitPop(warped, frame, stop) && frame)
+	{
+		int64 start = getTickCount();
+		writer.write(frame->dest);
+		ticks += getTickCount() - start;
+		++frames;
+		if (!WaitPush(free, frame, stop))
+		{
+			return;
+		}
+	}
+}
+
+bool RectifyVideo(const string& input, const string& output, Size size, const FrameWarp& warp,
+	const VideoPipelineParams& params, VideoPipelineStats* stats)
+{
+	CV_Assert(params.depth >= 1 && size.width > 0 && size.height > 0);
+
+	VideoCapture capture(input);
+	if (!capture.isOpened())
+	{
+		return false;
+	}
+	double fps = params.fps > 0 ? params.fps : capture.get(CAP_PROP_FPS);
+	VideoWriter writer(output, params.fourcc, fps > 0 ? fps : DEFAULT_FPS, size, true);
+	if (!writer.isOpened())
+	{
+		return false;
+	}
+
+	// every frame starts free, each queue can hold all of them plus the end
+	vector<PipelineFrame> pool(params.depth);
+	FrameQueue free(params.depth + 1), decoded(params.depth + 1), warped(params.depth + 1);
+	for (int i = 0; i < params.depth; ++i)
+	{
+		pool[i].dest.create(size, CV_8UC3);
+		free.TryPush(&pool[i]);
+	}
+
+	VideoPipelineStats local;
+	atomic<bool> stop(false);
+	int64 start = getTickCount();
+	thread decoder(DecodeStage, ref(capture), ref(free), ref(decoded), cref(stop), ref(local.decodeTicks));
+	thread encoder(EncodeStage, ref(writer), ref(warped), ref(free), cref(stop), ref(local.encodeTicks),
+		ref(local.frames));
+
+	// the warp stage; a throwing warp stops the other two before it leaves
+	try
+	{
+		PipelineFrame* frame;
+		while (WaitPop(decoded, frame, stop))
+		{
+			if (frame)
+			{
+				int64 warpStart = getTickCount();
+				warp(frame->src, frame->dest);
+				local.warpTicks += getTickCount() - warpStart;
+			}
+			if (!WaitPush(warped, frame, stop) || !frame)
+			{
+				break;
+			}
+		}
+	}
+	catch (...)
+	{
+		stop = true;
+		decoder.join();
+		encoder.join();
+		throw;
+	}
+	decoder.join();
+	encoder.join();
+	local.ticks = getTickCount() - start;
+
+	if (stats)
+	{
+		*stats = local;
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef VIDEO_PIPELINE_H
+#define VIDEO_PIPELINE_H
+
+#include <functional>                      // std::function
+#include <string>                          // std::string
+#include <opencv2/core/core.hpp>           // cv::Mat
+
+// Settings of RectifyVideo
+struct VideoPipelineParams
+{
+	int depth;   // frames in flight between the three stages
+	int fourcc;  // codec of the output, cv::VideoWriter::fourcc()
+	double fps;  // of the output, 0 takes the input's
+
+	VideoPipelineParams();
+};
+
+// Counters of a RectifyVideo call. Ticks are cv::getTickCount() units.
+struct VideoPipelineStats
+{
+	int64 frames;      // written to the output
+	int64 ticks;       // wall time from the first read to the last write
+	int64 decodeTicks; // inside VideoCapture::read
+	int64 warpTicks;   // inside the warp
+	int64 encodeTicks; // inside VideoWriter::write
+
+	VideoPipelineStats();
+
+	double Fps() const { return ticks ? frames * cv::getTickFrequency() / ticks : 0.; }
+
+	// Share of the wall time a stage spent working rather than waiting for
+	// the others, the stage close to 1 bounds the throughput
+	double Busy(int64 stageTicks) const { return ticks ? (double)stageTicks / ticks : 0.; }
+};
+
+// Rectifies src, a decoded frame, into dest, allocated at the output size
+typedef std::function<void(cv::Mat& src, cv::Mat& dest)> FrameWarp;
+
+// Decodes input, warps every frame into a size frame and encodes it into
+// output, in frame order. Decode and encode run on threads of their own and
+// warp on the calling thread, so the three stages overlap: while frame n is
+// warped, n + 1 is decoded and n - 1 encoded. The stages hand each other
+// a fixed pool of depth frames through lock free single producer single
+// consumer queues (SpscQueue), so nothing is allocated per frame and a
+// stage only waits when the pool is starved on its side.
+// Returns false when input cannot be opened or output cannot be created.
+bool RectifyVideo(const std::string& input, const std::string& output, cv::Size size, const FrameWarp& warp,
+	const VideoPipelineParams& params = VideoPipelineParams(), VideoPipelineStats* stats = 0);
+
+#endif
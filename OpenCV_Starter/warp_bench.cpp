@@ -0,0 +1,1705 @@
+// Headless benchmark of ProcessImg, ProcessImgCV and the warp engine backends,
+// no window is opened. Every case runs a few untimed warmups, then is timed
+// run by run; min, median and p99 latency are reported, optionally as JSON so
+// two builds can be diffed.
+// --check gates every backend on accuracy against warpPerspective and
+// --baseline on throughput against an earlier JSON run; a miss makes the exit
+// code nonzero so the bench can fail a build.
+#include <algorithm>                       // std::sort, std::max
+#include <atomic>                          // std::atomic
+#include <cfloat>                          // DBL_MAX
+#include <cstddef>                         // std::max_align_t
+#include <cstdio>                          // printf
+#include <cstdlib>                         // atoi, atof, malloc
+#include <cstring>                         // memset
+#include <fstream>                         // std::ofstream
+#include <functional>                      // std::function
+#include <iostream>                        // std::cout
+#include <map>                             // std::map
+#include <new>                             // std::bad_alloc, std::nothrow_t
+#include <string>                          // std::string
+#include <vector>                          // std::vector
+#include <opencv2/calib3d/calib3d.hpp>     // cv::findHomography()
+#include <opencv2/core/core.hpp>           // cv::Mat
+#include <opencv2/core/utility.hpp>        // cv::CommandLineParser
+#include <opencv2/imgcodecs/imgcodecs.hpp> // cv::imread()
+#include <opencv2/imgproc/imgproc.hpp>     // cv::getPerspectiveTransform()
+#include "court_detector.h"                // CourtDetector
+#include "frame_loader.h"                  // FrameLoader
+#include "frame_writer.h"                  // FrameWriter
+#include "homography.h"                    // SquareToQuadBatch()
+#include "img_process.h"                   // ProcessImg(), ProcessImgCV()
+#include "mapped_image.h"                  // MappedImage
+#include "warp_cache.h"                    // WarpMapCache
+#include "warp_engine.h"                   // WarpImg()
+
+#ifdef __linux__
+#include <linux/perf_event.h>              // perf_event_attr
+#include <sys/syscall.h>                   // __NR_perf_event_open
+#include <sys/ioctl.h>                     // ioctl()
+#include <unistd.h>                        // syscall(), read(), close()
+#endif
+
+using namespace std;
+using namespace cv;
+
+// accuracy gates against warpPerspective, per interpolation
+#define LINEAR_MAX_ERROR 8     // fixed point maps may land one 1/32 pixel step apart
+#define LINEAR_MIN_PSNR 50.
+#define NEAREST_MIN_PSNR 40.   // a coordinate on a rounding edge flips a whole pixel, so no max error gate
+#define KERNEL_MAX_ERROR 2     // cubic and Lanczos-4: separable quantized weights against remap's 2D ones
+#define KERNEL_MIN_PSNR 50.
+#define COURT_MAX_ERROR 3.     // CourtDetector corners against gCourtPts, in pixels
+#define JPEG_MIN_PSNR 30.      // FrameWriter jpeg at quality 95 read back; swapped channels fall far below
+
+// Court corners hand picked on the sample, the warp cases use them rather
+// than CourtDetector so their timings do not depend on the detector
+const Point2f gCourtPts[4] = { Point2f(22, 193), Point2f(246, 50), Point2f(402, 74), Point2f(278, 279) };
+
+int gIterations; // timed runs per case
+int gWarmup;     // untimed runs per case
+
+// Heap allocations through operator new, so CheckZeroCopy can tell a warp
+// allocated nothing. OpenCV takes the UMatData of every Mat it allocates and
+// the implementation of every cv::Mutex from operator new, so a hidden
+// image or lock is counted too, wherever this replacement reaches the
+// OpenCV libraries: shared libraries on Linux, static builds anywhere.
+// Every variant is replaced, plain, array, nothrow, sized and aligned, so no
+// allocation slips past the counter into the default implementation.
+atomic<int64> gAllocations(0);
+
+// Counts and allocates size bytes on an alignment boundary, 0 when out of
+// memory. The pointer malloc returned is kept just before the block.
+static void* CountedAlloc(size_t size, size_t alignment)
+{
+	++gAllocations;
+	alignment = std::max(alignment, (size_t)alignof(max_align_t));
+	void* base = malloc((size ? size : 1) + alignment);
+	if (!base)
+	{
+		return 0;
+	}
+	void** p = (void**)(((size_t)base + alignment) & ~(alignment - 1));
+	p[-1] = base;
+	return p;
+}
+
+static void CountedFree(void* p)
+{
+	if (p)
+	{
+		free(((void**)p)[-1]);
+	}
+}
+
+void* operator new(size_t size)
+{
+	void* p = CountedAlloc(size, 0);
+	if (!p)
+	{
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) throw()
+{
+	return CountedAlloc(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) throw()
+{
+	return CountedAlloc(size, 0);
+}
+
+void operator delete(void* p) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete(void* p, const nothrow_t&) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p, const nothrow_t&) throw()
+{
+	CountedFree(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, size_t) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p, size_t) throw()
+{
+	CountedFree(p);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, align_val_t alignment)
+{
+	void* p = CountedAlloc(size, (size_t)alignment);
+	if (!p)
+	{
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) throw()
+{
+	return CountedAlloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) throw()
+{
+	return CountedAlloc(size, (size_t)alignment);
+}
+
+void operator delete(void* p, align_val_t) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p, align_val_t) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete(void* p, size_t, align_val_t) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p, size_t, align_val_t) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete(void* p, align_val_t, const nothrow_t&) throw()
+{
+	CountedFree(p);
+}
+
+void operator delete[](void* p, align_val_t, const nothrow_t&) throw()
+{
+	CountedFree(p);
+}
+#endif
+
+// Timings of one case
+struct BenchResult
+{
+	string name;
+	Size input;
+	Size output;
+	int frames;       // frames warped per run
+	double minMs;     // per run
+	double medianMs;
+	double p99Ms;
+	double mps;       // output megapixels per second at the median
+	double maxErr;    // against ProcessImgCV, -1 when not compared
+	WarpStats stats;  // summed over the timed runs, empty for cases not using WarpParams
+};
+
+vector<BenchResult> gResults;
+
+// Runs run gWarmup + gIterations times, it gets the stats to pass in
+// WarpParams::stats when timed and null during warmup
+BenchResult Measure(const string& name, Size input, Size output, int frames, const function<void(WarpStats*)>& run)
+{
+	for (int i = 0; i < gWarmup; ++i)
+	{
+		run(0);
+	}
+
+	BenchResult result;
+	vector<double> ms(gIterations);
+	for (int i = 0; i < gIterations; ++i)
+	{
+		int64 start = getTickCount();
+		run(&result.stats);
+		ms[i] = (getTickCount() - start) * 1000. / getTickFrequency();
+	}
+	sort(ms.begin(), ms.end());
+
+	result.name = name;
+	result.input = input;
+	result.output = output;
+	result.frames = frames;
+	result.minMs = ms[0];
+	result.medianMs = ms[ms.size() / 2];
+	result.p99Ms = ms[min(ms.size() - 1, (size_t)(ms.size() * 0.99))];
+	result.mps = (double)output.area() * frames / (result.medianMs * 1000.);
+	result.maxErr = -1;
+	return result;
+}
+
+// Prints r and keeps it for the JSON output
+void Report(const BenchResult& r)
+{
+	printf("  %-24s %3d frames  min %8.3f  median %8.3f  p99 %8.3f ms  %8.1f MP/s",
+		r.name.c_str(), r.frames, r.minMs, r.medianMs, r.p99Ms, r.mps);
+	if (r.maxErr >= 0)
+	{
+		printf("  max error %g", r.maxErr);
+	}
+	if (r.stats.rows)
+	{
+		printf("  map %.0f gather %.0f cycles/row, %.1f%% covered", (double)r.stats.mapTicks / r.stats.rows,
+			(double)r.stats.gatherTicks / r.stats.rows, r.stats.CoveredRatio() * 100.);
+	}
+	printf("\n");
+
+	gResults.push_back(r);
+}
+
+bool WriteJson(const string& path)
+{
+	ofstream out(path.c_str());
+	if (!out)
+	{
+		return false;
+	}
+
+	out << "{\n  \"iterations\": " << gIterations << ",\n  \"warmup\": " << gWarmup
+		<< ",\n  \"threads\": " << getNumThreads() << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < gResults.size(); ++i)
+	{
+		const BenchResult& r = gResults[i];
+		out << "    { \"name\": \"" << r.name << "\", \"input\": [" << r.input.width << ", " << r.input.height
+			<< "], \"output\": [" << r.output.width << ", " << r.output.height << "], \"frames\": " << r.frames
+			<< ", \"min_ms\": " << r.minMs << ", \"median_ms\": " << r.medianMs << ", \"p99_ms\": " << r.p99Ms
+			<< ", \"mp_per_s\": " << r.mps;
+		if (r.maxErr >= 0)
+		{
+			out << ", \"max_error\": " << r.maxErr;
+		}
+		if (r.stats.rows)
+		{
+			out << ", \"map_cycles_per_row\": " << (double)r.stats.mapTicks / r.stats.rows
+				<< ", \"gather_cycles_per_row\": " << (double)r.stats.gatherTicks / r.stats.rows
+				<< ", \"covered\": " << r.stats.CoveredRatio();
+		}
+		out << " }" << (i + 1 < gResults.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return !out.fail();
+}
+
+// Points ProcessImg and ProcessImgCV at the picked quad scaled by scale and
+// a size target, returns the homography ProcessImgCV builds from them
+Mat SetCourt(const vector<Point2f>& pickPts, float scale, Size size)
+{
+	for (size_t i = 0; i < pickPts.size(); ++i)
+	{
+		gDistortPts[i] = pickPts[i] * scale;
+	}
+	Point2f corners[4] = { Point2f(0, 0), Point2f(size.width - 1.f, 0),
+		Point2f(size.width - 1.f, size.height - 1.f), Point2f(0, size.height - 1.f) };
+	gTargetPts.assign(corners, corners + 4);
+	return getPerspectiveTransform(&gDistortPts[0], &gTargetPts[0]);
+}
+
+// Warps src into a reference sized frame with params
+void BenchWarp(const string& name, const Mat& src, const Mat& M, const WarpParams& base, const Mat& reference)
+{
+	Mat dest(reference.size(), src.type());
+	BenchResult r = Measure(name, src.size(), dest.size(), 1, [&](WarpStats* stats)
+	{
+		WarpParams params = base;
+		params.stats = stats;
+		WarpImg(src, dest, M, params);
+	});
+	r.maxErr = norm(dest, reference, NORM_INF);
+	Report(r);
+}
+
+// Every path on one frame, SetCourt must have been called for it
+void BenchFrame(const Mat& src, const Mat& M, Size size)
+{
+	Mat input = src;
+	Mat reference(size, src.type());
+	ProcessImgCV(input, reference);
+
+	cout << "Input " << src.cols << "x" << src.rows << ", output " << size.width << "x" << size.height << "\n";
+
+	Mat dest(size, src.type());
+	Report(Measure("ProcessImgCV", src.size(), size, 1, [&](WarpStats*)
+	{
+		ProcessImgCV(input, dest);
+	}));
+
+	BenchResult r = Measure("ProcessImg", src.size(), size, 1, [&](WarpStats*)
+	{
+		ProcessImg(input, dest);
+	});
+	r.maxErr = norm(dest, reference, NORM_INF);
+	Report(r);
+
+	WarpParams params;
+	params.mapMode = WARP_MAP_SCALAR;
+	BenchWarp("warp scalar", src, M, params, reference);
+	params.mapMode = WARP_MAP_INCREMENTAL;
+	BenchWarp("warp incremental", src, M, params, reference);
+	params.mapMode = WARP_MAP_SIMD;
+	BenchWarp("warp simd", src, M, params, reference);
+	double linearMs = gResults.back().medianMs;
+	params.fixedPoint = false;
+	BenchWarp("warp simd, float blend", src, M, params, reference);
+	params.fixedPoint = true;
+	params.cull = false;
+	BenchWarp("warp simd, no culling", src, M, params, reference);
+
+	// the sharper kernels, against warpPerspective with the same interpolation
+	const int kernels[] = { INTER_CUBIC, INTER_LANCZOS4 };
+	const char* kernelNames[] = { "cubic", "lanczos4" };
+	for (int k = 0; k < 2; ++k)
+	{
+		Mat kernelReference(size, src.type());
+		Report(Measure(string("warpPerspective ") + kernelNames[k], src.size(), size, 1, [&](WarpStats*)
+		{
+			warpPerspective(src, kernelReference, M, size, kernels[k], BORDER_CONSTANT);
+		}));
+
+		WarpParams kernelParams;
+		kernelParams.interpolation = kernels[k];
+		BenchWarp(string("warp ") + kernelNames[k], src, M, kernelParams, kernelReference);
+		printf("    %.2fx the time of warp simd\n", gResults.back().medianMs / linearMs);
+	}
+
+	WarpMapCache cache;
+	BenchResult cached = Measure("warp cached maps", src.size(), size, 1, [&](WarpStats* stats)
+	{
+		WarpParams params;
+		params.stats = stats;
+		cache.Warp(src, dest, M, params);
+	});
+	cached.maxErr = norm(dest, reference, NORM_INF);
+	Report(cached);
+}
+
+// WarpBatch against ProcessImgCV frame by frame, the frames are separate
+// copies of src so each one is fetched from memory
+void BenchBatch(const Mat& src, const Mat& M, Size size, int frames)
+{
+	vector<Mat> srcs(frames), dests, references(frames);
+	for (int f = 0; f < frames; ++f)
+	{
+		src.copyTo(srcs[f]);
+		references[f].create(size, src.type());
+	}
+
+	char name[64];
+	sprintf(name, "ProcessImgCV x%d", frames);
+	Report(Measure(name, src.size(), size, frames, [&](WarpStats*)
+	{
+		for (int f = 0; f < frames; ++f)
+		{
+			ProcessImgCV(srcs[f], references[f]);
+		}
+	}));
+
+	sprintf(name, "WarpBatch x%d", frames);
+	BenchResult r = Measure(name, src.size(), size, frames, [&](WarpStats* stats)
+	{
+		WarpParams params;
+		params.stats = stats;
+		WarpBatch(srcs, dests, M, size, params);
+	});
+	r.maxErr = 0;
+	for (int f = 0; f < frames; ++f)
+	{
+		r.maxErr = max(r.maxErr, norm(dests[f], references[f], NORM_INF));
+	}
+	Report(r);
+}
+
+// Homographies of many court sized quads: getPerspectiveTransform, GetProjMat
+// one by one and SquareToQuadBatch, in nanoseconds per quad. Jittered corners
+// make some quads concave; GetProjMat asserts on those, so it is only timed on
+// the quads SquareToQuadBatch marks valid.
+void BenchQuadSolver(int quads)
+{
+	RNG rng(0x5eed);
+	vector<float> planes[12];
+	for (int k = 0; k < 4; ++k)
+	{
+		planes[k].resize(quads);
+		planes[4 + k].resize(quads);
+		for (int i = 0; i < quads; ++i)
+		{
+			planes[k][i] = gDistortPts[k].x + rng.uniform(-40.f, 40.f);
+			planes[4 + k][i] = gDistortPts[k].y + rng.uniform(-40.f, 40.f);
+		}
+	}
+	const float* qx[4] = { &planes[0][0], &planes[1][0], &planes[2][0], &planes[3][0] };
+	const float* qy[4] = { &planes[4][0], &planes[5][0], &planes[6][0], &planes[7][0] };
+	vector<float> h(quads * 8);
+	float* hp[8];
+	for (int j = 0; j < 8; ++j)
+	{
+		hp[j] = &h[j * quads];
+	}
+	vector<uchar> valid(quads);
+	int degenerate = SquareToQuadBatch(qx, qy, quads, hp, &valid[0]);
+
+	Point2f corners[4] = { Point2f(0, 0), Point2f(TARGET_COL - 1.f, 0),
+		Point2f(TARGET_COL - 1.f, TARGET_ROW - 1.f), Point2f(0, TARGET_ROW - 1.f) };
+	double ns[3] = { 0, 0, 0 };
+	for (int it = 0; it < gIterations; ++it)
+	{
+		int64 t0 = getTickCount();
+		for (int i = 0; i < quads; ++i)
+		{
+			Point2f quad[4] = { Point2f(qx[0][i], qy[0][i]), Point2f(qx[1][i], qy[1][i]),
+				Point2f(qx[2][i], qy[2][i]), Point2f(qx[3][i], qy[3][i]) };
+			getPerspectiveTransform(quad, corners);
+		}
+		int64 t1 = getTickCount();
+		for (int i = 0; i < quads; ++i)
+		{
+			if (!valid[i])
+			{
+				continue;
+			}
+			Point2f quad[4] = { Point2f(qx[0][i], qy[0][i]), Point2f(qx[1][i], qy[1][i]),
+				Point2f(qx[2][i], qy[2][i]), Point2f(qx[3][i], qy[3][i]) };
+			Matx33f H = GetProjMat(quad, TARGET_ROW, TARGET_COL);
+			h[i] = H.val[0];
+		}
+		int64 t2 = getTickCount();
+		SquareToQuadBatch(qx, qy, quads, hp);
+		int64 t3 = getTickCount();
+
+		ns[0] += (t1 - t0) * 1e9 / getTickFrequency();
+		ns[1] += (t2 - t1) * 1e9 / getTickFrequency();
+		ns[2] += (t3 - t2) * 1e9 / getTickFrequency();
+	}
+
+	double runs = (double)gIterations * quads;
+	double convexRuns = (double)gIterations * max(quads - degenerate, 1);
+	cout << "Square to quad, " << quads << " quads: getPerspectiveTransform " << ns[0] / runs
+		<< " ns/quad, GetProjMat " << ns[1] / convexRuns << " ns/quad, SquareToQuadBatch " << ns[2] / runs
+		<< " ns/quad, " << degenerate << " degenerate\n";
+}
+
+// Mean distance between where H and the true homography M put the inliers
+double MeanReprojError(const Matx33d& H, const Matx33d& M, const vector<Point2f>& pts, const vector<uchar>& outlier)
+{
+	double sum = 0;
+	int count = 0;
+	for (size_t i = 0; i < pts.size(); ++i)
+	{
+		if (outlier[i])
+		{
+			continue;
+		}
+		Vec3d p = H * Vec3d(pts[i].x, pts[i].y, 1);
+		Vec3d q = M * Vec3d(pts[i].x, pts[i].y, 1);
+		sum += norm(Point2d(p[0] / p[2] - q[0] / q[2], p[1] / p[2] - q[1] / q[2]));
+		++count;
+	}
+	return sum / count;
+}
+
+// EstimateHomography against findHomography with RANSAC on court points
+// mapped by the true homography, with 0.5 pixel noise and outliers
+void BenchHomography(const Mat& M, int count, double outlierRatio)
+{
+	RNG rng(0x5eed);
+	vector<Point2f> src(count), dst(count);
+	vector<uchar> outlier(count);
+	Matx33d trueH = M;
+	for (int i = 0; i < count; ++i)
+	{
+		src[i] = Point2f(rng.uniform(22.f, 402.f), rng.uniform(50.f, 279.f));
+		outlier[i] = rng.uniform(0., 1.) < outlierRatio;
+		if (outlier[i])
+		{
+			dst[i] = Point2f(rng.uniform(0.f, (float)TARGET_COL), rng.uniform(0.f, (float)TARGET_ROW));
+			continue;
+		}
+		Vec3d p = trueH * Vec3d(src[i].x, src[i].y, 1);
+		dst[i] = Point2f((float)(p[0] / p[2] + rng.gaussian(0.5)), (float)(p[1] / p[2] + rng.gaussian(0.5)));
+	}
+
+	Mat cvH;
+	vector<uchar> cvMask, mask;
+	int64 start = getTickCount();
+	for (int i = 0; i < gIterations; ++i)
+	{
+		cvH = findHomography(src, dst, RANSAC, 3., cvMask);
+	}
+	double cvMs = (getTickCount() - start) * 1000. / getTickFrequency() / gIterations;
+
+	Matx33d H;
+	RansacStats stats;
+	RansacParams params;
+	params.threshold = 3.;
+	params.stats = &stats;
+	start = getTickCount();
+	for (int i = 0; i < gIterations; ++i)
+	{
+		EstimateHomography(src, dst, H, params, &mask);
+	}
+	double ms = (getTickCount() - start) * 1000. / getTickFrequency() / gIterations;
+
+	printf("  %5d points, %2.0f%% outliers: findHomography %7.3f ms, %5d inliers, error %.3f px | "
+		"EstimateHomography %7.3f ms, %5d inliers, error %.3f px, %d hypotheses\n",
+		count, outlierRatio * 100., cvMs, countNonZero(cvMask), cvH.empty() ? -1. : MeanReprojError(cvH, trueH, src, outlier),
+		ms, stats.inliers, MeanReprojError(H, trueH, src, outlier), stats.hypotheses);
+}
+
+// TemporalWarp on a tracked court: the corners drift slowly and jitter by
+// about 0.1 pixel per frame, as corners from a tracker do. Reports the map
+// rebuild rate and the mean error against warping every frame exactly.
+void BenchTemporal(const Mat& src, Size size, int frames)
+{
+	RNG rng(0x5eed);
+	vector<Point2f> quads(frames * 4);
+	for (int f = 0; f < frames; ++f)
+	{
+		Point2f drift(f * 0.01f, f * -0.005f);
+		for (int i = 0; i < 4; ++i)
+		{
+			quads[f * 4 + i] = gDistortPts[i] + drift + Point2f((float)rng.gaussian(0.08), (float)rng.gaussian(0.08));
+		}
+	}
+
+	// the exact output of every frame
+	Point2f corners[4] = { Point2f(0, 0), Point2f(size.width - 1.f, 0),
+		Point2f(size.width - 1.f, size.height - 1.f), Point2f(0, size.height - 1.f) };
+	vector<Mat> references(frames);
+	for (int f = 0; f < frames; ++f)
+	{
+		references[f].create(size, src.type());
+		WarpImg(src, references[f], getPerspectiveTransform(&quads[f * 4], corners));
+	}
+
+	cout << "Temporal reuse, " << frames << " tracked frames, output " << size.width << "x" << size.height << "\n";
+	Mat dest(size, src.type());
+	Report(Measure("warp every frame", src.size(), size, frames, [&](WarpStats* stats)
+	{
+		WarpParams params;
+		params.stats = stats;
+		for (int f = 0; f < frames; ++f)
+		{
+			WarpImg(src, dest, getPerspectiveTransform(&quads[f * 4], corners), params);
+		}
+	}));
+
+	double epsilons[] = { 0.25, 0.5, 1. };
+	for (int e = 0; e < 3; ++e)
+	{
+		for (int correct = 0; correct < 2; ++correct)
+		{
+			char name[64];
+			sprintf(name, "temporal %.2f%s", epsilons[e], correct ? ", shifted" : "");
+			TemporalWarp temporal(epsilons[e], correct != 0);
+			Report(Measure(name, src.size(), size, frames, [&](WarpStats* stats)
+			{
+				WarpParams params;
+				params.stats = stats;
+				temporal.Reset();
+				for (int f = 0; f < frames; ++f)
+				{
+					temporal.Warp(src, &quads[f * 4], dest, params);
+				}
+			}));
+
+			// one more pass to measure the error of every frame
+			temporal.Reset();
+			double error = 0;
+			for (int f = 0; f < frames; ++f)
+			{
+				temporal.Warp(src, &quads[f * 4], dest);
+				error += norm(dest, references[f], NORM_L1) / ((double)dest.total() * dest.channels());
+			}
+			TemporalWarpStats stats = temporal.GetStats();
+			printf("    %.1f%% of frames rebuilt the maps, %.1f%% shifted them, mean error %.3f\n",
+				stats.RebuildRate() * 100., (double)stats.corrections / stats.frames * 100., error / frames);
+		}
+	}
+}
+
+// Largest distance of corners from the hand picked ones scaled by scale and
+// moved by offset
+double CornerError(const Point2f corners[4], float scale, Point2f offset)
+{
+	double error = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		error = max(error, norm(corners[i] - (gCourtPts[i] * scale + offset)));
+	}
+	return error;
+}
+
+// CourtDetector on the court as shot and on a 1080p video of it: a full
+// search per frame, then tracking over a slow pan. Returns the number of
+// frames whose corners miss gCourtPts by more than COURT_MAX_ERROR, the pan
+// frames are upscaled so they are only reported.
+int BenchCourt(const Mat& src, int frames)
+{
+	int failures = 0;
+	cout << "Court detection\n";
+
+	CourtDetectorParams searchParams;
+	searchParams.track = false;
+	CourtDetector search(searchParams);
+	Point2f corners[4];
+	bool found = search.Detect(src, corners);
+	double error = found ? CornerError(corners, 1.f, Point2f()) : -1.;
+	bool pass = found && error <= COURT_MAX_ERROR;
+	failures += !pass;
+	printf("  input %dx%d: %s, max corner error %.2f px  %s\n", src.cols, src.rows, found ? "found" : "no court",
+		error, pass ? "pass" : "FAIL");
+
+	// 1080p frames panning across a 4x upscale of the court
+	float scale = 4.f;
+	Mat large;
+	resize(src, large, Size(), scale, scale, INTER_LINEAR);
+	Size size(1920, 1080);
+	vector<Point> offsets(frames);
+	vector<Mat> video(frames);
+	for (int f = 0; f < frames; ++f)
+	{
+		offsets[f] = Point(f / 2, 120 + f);
+		video[f] = large(Rect(offsets[f], size)).clone();
+	}
+
+	Report(Measure("court search", size, size, 1, [&](WarpStats*)
+	{
+		search.Detect(video[0], corners);
+	}));
+
+	CourtDetector tracker;
+	double maxError = 0;
+	Report(Measure("court tracking", size, size, frames, [&](WarpStats*)
+	{
+		tracker.Reset();
+		for (int f = 0; f < frames; ++f)
+		{
+			if (tracker.Detect(video[f], corners))
+			{
+				maxError = max(maxError, CornerError(corners, scale, -Point2f(offsets[f])));
+			}
+		}
+	}));
+
+	const BenchResult& r = gResults.back();
+	CourtDetectorStats stats = tracker.GetStats();
+	printf("    %.0f fps tracked, %.1f%% of frames tracked, %lld searches, %lld misses, max corner error %.1f px at %gx\n",
+		frames * 1000. / r.medianMs, (double)stats.tracked / stats.frames * 100., (long long)stats.searches,
+		(long long)stats.misses, maxError, scale);
+	return failures;
+}
+
+// The court and its two halves rectified into one composite output: one
+// warpPerspective per region over the whole output, one WarpImg per region
+// into its rect and a single WarpMosaic. Returns 1 when the mosaic differs
+// from the per region WarpImg output.
+int BenchMosaic(const Mat& src)
+{
+	Point2f midBottom = (gCourtPts[0] + gCourtPts[3]) * 0.5f;
+	Point2f midTop = (gCourtPts[1] + gCourtPts[2]) * 0.5f;
+	Point2f left[4] = { gCourtPts[0], gCourtPts[1], midTop, midBottom };
+	Point2f right[4] = { midBottom, midTop, gCourtPts[2], gCourtPts[3] };
+	vector<MosaicRegion> regions;
+	regions.push_back(MosaicRegion(gCourtPts, Rect(0, 0, TARGET_COL, TARGET_ROW)));
+	regions.push_back(MosaicRegion(left, Rect(0, TARGET_ROW, TARGET_COL / 2, TARGET_ROW / 2)));
+	regions.push_back(MosaicRegion(right, Rect(TARGET_COL / 2, TARGET_ROW, TARGET_COL / 2, TARGET_ROW / 2)));
+	Size size(TARGET_COL, TARGET_ROW * 3 / 2);
+
+	// destination -> source of each region, as WarpMosaic builds it
+	vector<Matx33d> maps(regions.size());
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		Rect r = regions[i].rect;
+		SquareToQuad(regions[i].quad, maps[i]);
+		maps[i] = maps[i] * Matx33d(1. / (r.width - 1), 0, 0, 0, 1. / (r.height - 1), 0, 0, 0, 1);
+	}
+
+	cout << "Mosaic, " << regions.size() << " regions, input " << src.cols << "x" << src.rows << ", output "
+		<< size.width << "x" << size.height << "\n";
+	Mat full(size, src.type());
+	Mat reference(size, src.type(), Scalar::all(0));
+	Report(Measure("warpPerspective/region", src.size(), size, 1, [&](WarpStats*)
+	{
+		for (size_t i = 0; i < regions.size(); ++i)
+		{
+			Rect r = regions[i].rect;
+			Matx33d shifted = maps[i] * Matx33d(1, 0, -r.x, 0, 1, -r.y, 0, 0, 1);
+			warpPerspective(src, full, shifted, size, INTER_LINEAR | WARP_INVERSE_MAP, BORDER_CONSTANT);
+			full(r).copyTo(reference(r));
+		}
+	}));
+
+	Mat perRegion(size, src.type(), Scalar::all(0));
+	Report(Measure("warp/region", src.size(), size, 1, [&](WarpStats* stats)
+	{
+		WarpParams params;
+		params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+		params.stats = stats;
+		for (size_t i = 0; i < regions.size(); ++i)
+		{
+			Mat view = perRegion(regions[i].rect);
+			WarpImg(src, view, maps[i], params);
+		}
+	}));
+
+	Mat dest(size, src.type());
+	BenchResult r = Measure("warp mosaic", src.size(), size, 1, [&](WarpStats* stats)
+	{
+		WarpParams params;
+		params.stats = stats;
+		WarpMosaic(src, dest, regions, params);
+	});
+	r.maxErr = norm(dest, reference, NORM_INF);
+	Report(r);
+
+	bool pass = norm(dest, perRegion, NORM_INF) == 0;
+	printf("    mosaic against WarpImg per region: %s\n", pass ? "identical  pass" : "differs  FAIL");
+	return !pass;
+}
+
+// Keeps CV_Assert quiet while CheckZeroCopy has it fail on purpose
+static int IgnoreError(int, const char*, const char*, const char*, int, void*)
+{
+	return 0;
+}
+
+// WarpImg from and into caller buffers (WarpBuffer): both have odd strides
+// and start off any alignment, the destination rows are padded and followed
+// by guard bytes. Gates on the output matching WarpImg on Mats, the padding
+// and guard bytes being left alone, not a single heap allocation on one
+// thread whatever the settings, and bad buffers being refused. Times it
+// against a warp into a newly allocated Mat copied out to the caller, what
+// the callers did before, and into a destination with 16-byte aligned rows.
+int CheckZeroCopy(const Mat& src, const Mat& M, Size size)
+{
+	const uchar PAD = 0xa5;
+	const size_t GUARD = 64;
+
+	size_t srcStep = src.cols * src.elemSize() + 7;
+	vector<uchar> srcMemory(srcStep * src.rows + 1);
+	WarpBuffer srcBuffer(&srcMemory[1], src.size(), src.type(), srcStep);
+	for (int y = 0; y < src.rows; ++y)
+	{
+		memcpy(&srcMemory[1] + y * srcStep, src.ptr(y), src.cols * src.elemSize());
+	}
+
+	size_t rowBytes = size.width * src.elemSize(), destStep = rowBytes + 13;
+	vector<uchar> destMemory(destStep * size.height + 1 + GUARD);
+	WarpBuffer destBuffer(&destMemory[1], size, src.type(), destStep);
+
+	struct ZeroCopyCase
+	{
+		const char* name;
+		int interpolation;
+		int mapMode;
+		bool tiled;
+		bool stats;
+	};
+	const ZeroCopyCase cases[] = {
+		{ "linear simd", INTER_LINEAR, WARP_MAP_SIMD, false, false },
+		{ "linear scalar", INTER_LINEAR, WARP_MAP_SCALAR, false, false },
+		{ "linear incremental", INTER_LINEAR, WARP_MAP_INCREMENTAL, false, false },
+		{ "linear tiled", INTER_LINEAR, WARP_MAP_SIMD, true, false },
+		{ "linear, stats", INTER_LINEAR, WARP_MAP_SIMD, false, true },
+		{ "linear tiled, stats", INTER_LINEAR, WARP_MAP_SIMD, true, true },
+		{ "nearest", INTER_NEAREST, WARP_MAP_SIMD, false, false },
+		{ "cubic", INTER_CUBIC, WARP_MAP_SIMD, false, false },
+		{ "lanczos4", INTER_LANCZOS4, WARP_MAP_SIMD, false, false },
+	};
+
+	cout << "Zero copy, input " << src.cols << "x" << src.rows << ", output " << size.width << "x" << size.height
+		<< ", caller buffers\n";
+	int failures = 0;
+	Mat reference(size, src.type());
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+	{
+		const ZeroCopyCase& c = cases[i];
+		WarpStats stats;
+		WarpParams params;
+		params.interpolation = c.interpolation;
+		params.mapMode = c.mapMode;
+		params.tiled = c.tiled;
+		params.numThreads = 1;
+		params.stats = c.stats ? &stats : 0;
+		WarpImg(src, reference, M, params);
+
+		memset(&destMemory[0], PAD, destMemory.size());
+		int64 before = gAllocations;
+		WarpImg(srcBuffer, destBuffer, M, params);
+		int64 allocations = gAllocations - before;
+
+		bool same = true, padded = true;
+		for (int y = 0; y < size.height; ++y)
+		{
+			const uchar* row = &destMemory[1] + y * destStep;
+			same = same && memcmp(row, reference.ptr(y), rowBytes) == 0;
+			for (size_t b = rowBytes; b < destStep && y < size.height - 1; ++b)
+			{
+				padded = padded && row[b] == PAD;
+			}
+		}
+		for (size_t b = destMemory.size() - GUARD; b < destMemory.size(); ++b)
+		{
+			padded = padded && destMemory[b] == PAD;
+		}
+		padded = padded && destMemory[0] == PAD;
+
+		bool pass = same && padded && allocations == 0;
+		printf("    %-22s %s, padding %s, %lld allocations  %s\n", c.name, same ? "same as on Mats" : "DIFFERS",
+			padded ? "intact" : "OVERWRITTEN", (long long)allocations, pass ? "pass" : "FAIL");
+		failures += !pass;
+	}
+
+	// a step shorter than a row, a 16-bit type, a type other than the
+	// source's and a destination overlapping the source
+	WarpBuffer bad[4] = { destBuffer, destBuffer, destBuffer, srcBuffer };
+	bad[0].step = rowBytes - 1;
+	bad[1].type = CV_16UC3;
+	bad[2].type = CV_8UC1;
+	int refused = 0;
+	ErrorCallback previous = redirectError(IgnoreError);
+	for (int i = 0; i < 4; ++i)
+	{
+		try
+		{
+			WarpImg(srcBuffer, bad[i], M);
+		}
+		catch (const cv::Exception&)
+		{
+			++refused;
+		}
+	}
+	redirectError(previous);
+	printf("    %d of 4 bad buffers refused  %s\n", refused, refused == 4 ? "pass" : "FAIL");
+	failures += refused != 4;
+
+	// the same destination with its rows on 16-byte boundaries
+	size_t alignedStep = (rowBytes + 15) & ~(size_t)15;
+	vector<uchar> alignedMemory(alignedStep * size.height + 15);
+	WarpBuffer alignedBuffer((void*)(((size_t)&alignedMemory[0] + 15) & ~(size_t)15), size, src.type(), alignedStep);
+	bool aligned = !WarpBufferAligned(srcBuffer) && !WarpBufferAligned(destBuffer) && WarpBufferAligned(alignedBuffer);
+	printf("    rows 16-byte aligned: source %s, destination %s, aligned destination %s  %s\n",
+		WarpBufferAligned(srcBuffer) ? "yes" : "no", WarpBufferAligned(destBuffer) ? "yes" : "no",
+		WarpBufferAligned(alignedBuffer) ? "yes" : "no", aligned ? "pass" : "FAIL");
+	failures += !aligned;
+
+	WarpParams params;
+	params.numThreads = 1;
+	Report(Measure("warp into new Mat, copy", src.size(), size, 1, [&](WarpStats*)
+	{
+		Mat dest = Mat::zeros(size, src.type());
+		WarpImg(src, dest, M, params);
+		for (int y = 0; y < size.height; ++y)
+		{
+			memcpy(&destMemory[1] + y * destStep, dest.ptr(y), rowBytes);
+		}
+	}));
+	Report(Measure("warp into caller buffer", src.size(), size, 1, [&](WarpStats*)
+	{
+		WarpImg(srcBuffer, destBuffer, M, params);
+	}));
+	Report(Measure("warp into aligned buffer", src.size(), size, 1, [&](WarpStats*)
+	{
+		WarpImg(srcBuffer, alignedBuffer, M, params);
+	}));
+	return failures;
+}
+
+// Warps src by the destination -> source map H into size, supersampled k x k
+// and box filtered down
+void WarpSupersampled(const Mat& src, const Matx33d& H, Size size, int k, Mat& large, Mat& dest)
+{
+	// pixel (x, y) of the large output is the center of sub-sample
+	// ((x + 0.5) / k - 0.5, (y + 0.5) / k - 0.5) of the output
+	double offset = (1. / k - 1.) * 0.5;
+	Matx33d Hk = H * Matx33d(1. / k, 0, offset, 0, 1. / k, offset, 0, 0, 1);
+	large.create(size.height * k, size.width * k, src.type());
+	WarpParams params;
+	params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+	WarpImg(src, large, Hk, params);
+	resize(large, dest, size, 0, 0, INTER_AREA);
+}
+
+// The court rectified from a 4x frame, where the near end is minified:
+// bilinear, 2x2 and 4x4 supersampling and WarpPyramid, timed with the
+// pyramid built every frame. Quality is the PSNR against 8x8 supersampling.
+void BenchAntiAliasing(const Mat& src, float scale, Size size)
+{
+	Point2f quad[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		quad[i] = gCourtPts[i] * scale;
+	}
+	Matx33d H;
+	SquareToQuad(quad, H);
+	H = H * Matx33d(1. / (size.width - 1), 0, 0, 0, 1. / (size.height - 1), 0, 0, 0, 1);
+
+	Mat large, reference;
+	WarpSupersampled(src, H, size, 8, large, reference);
+
+	cout << "Anti-aliasing, input " << src.cols << "x" << src.rows << ", output " << size.width << "x" << size.height
+		<< ", PSNR against 8x8 supersampling\n";
+	Mat dest(size, src.type());
+	WarpParams params;
+	params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+	Report(Measure("bilinear", src.size(), size, 1, [&](WarpStats* stats)
+	{
+		WarpParams timed = params;
+		timed.stats = stats;
+		WarpImg(src, dest, H, timed);
+	}));
+	printf("    %.1f dB\n", PSNR(dest, reference));
+
+	for (int k = 2; k <= 4; k += 2)
+	{
+		char name[64];
+		sprintf(name, "supersampled %dx%d", k, k);
+		Report(Measure(name, src.size(), size, 1, [&](WarpStats*)
+		{
+			WarpSupersampled(src, H, size, k, large, dest);
+		}));
+		printf("    %.1f dB\n", PSNR(dest, reference));
+	}
+
+	vector<Mat> pyramid;
+	Report(Measure("pyramid trilinear", src.size(), size, 1, [&](WarpStats* stats)
+	{
+		WarpParams timed = params;
+		timed.stats = stats;
+		buildPyramid(src, pyramid, 4);
+		WarpPyramid(pyramid, dest, H, timed);
+	}));
+	printf("    %.1f dB\n", PSNR(dest, reference));
+}
+
+// Hardware cache counters of the calling thread, through perf_event_open on
+// Linux. Last level cache references are the accesses that missed L2.
+struct CacheCounters
+{
+	int fds[2]; // last level cache references and misses, -1 when unavailable
+
+	CacheCounters()
+	{
+		fds[0] = fds[1] = -1;
+#ifdef __linux__
+		const unsigned long long configs[2] = { PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES };
+		for (int i = 0; i < 2; ++i)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+
+	~CacheCounters()
+	{
+#ifdef __linux__
+		for (int i = 0; i < 2; ++i)
+		{
+			if (fds[i] >= 0)
+			{
+				close(fds[i]);
+			}
+		}
+#endif
+	}
+
+	bool Available() const { return fds[0] >= 0 && fds[1] >= 0; }
+
+	// Counts what run does, false when the counters are unavailable
+	bool Count(const function<void()>& run, int64 counts[2])
+	{
+		if (!Available())
+		{
+			run();
+			return false;
+		}
+#ifdef __linux__
+		for (int i = 0; i < 2; ++i)
+		{
+			ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+		run();
+		for (int i = 0; i < 2; ++i)
+		{
+			ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			long long value = 0;
+			counts[i] = read(fds[i], &value, sizeof(value)) == sizeof(value) ? value : 0;
+		}
+#endif
+		return true;
+	}
+};
+
+// Row order against tiled warping of an 8K source, on the court and on the
+// court turned by 90 degrees, where every destination row walks down the
+// source. Single threaded so the cache counters see the whole warp.
+void BenchTiled(const Mat& src, Size size)
+{
+	float scale = 7680.f / src.cols;
+	Mat large;
+	resize(src, large, Size(7680, cvRound(src.rows * scale)), 0, 0, INTER_LINEAR);
+
+	Point2f court[4], turned[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		court[i] = gCourtPts[i] * scale;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		turned[i] = court[(i + 1) & 3];
+	}
+	const Point2f* quads[2] = { court, turned };
+	const char* names[2] = { "court", "turned court" };
+
+	cout << "Tiled, input " << large.cols << "x" << large.rows << ", output " << size.width << "x" << size.height << "\n";
+	CacheCounters counters;
+	if (!counters.Available())
+	{
+		printf("    no cache counters, perf_event_open is unavailable\n");
+	}
+
+	Mat rows(size, large.type()), tiled(size, large.type());
+	for (int q = 0; q < 2; ++q)
+	{
+		Matx33d M;
+		SquareToQuad(quads[q], M);
+		M = M * Matx33d(1. / (size.width - 1), 0, 0, 0, 1. / (size.height - 1), 0, 0, 0, 1);
+
+		WarpParams params;
+		params.interpolation = INTER_LINEAR | WARP_INVERSE_MAP;
+		params.numThreads = 1;
+		int64 counts[2][2] = {};
+		for (int t = 0; t < 2; ++t)
+		{
+			params.tiled = t != 0;
+			Mat& dest = t ? tiled : rows;
+			string name = string(names[q]) + (t ? ", tiled" : ", rows");
+			BenchResult r = Measure(name, large.size(), size, 1, [&](WarpStats* stats)
+			{
+				WarpParams timed = params;
+				timed.stats = stats;
+				WarpImg(large, dest, M, timed);
+			});
+			if (t)
+			{
+				r.maxErr = norm(tiled, rows, NORM_INF);
+			}
+			Report(r);
+			counters.Count([&]() { WarpImg(large, dest, M, params); }, counts[t]);
+		}
+
+		Size tile = ChooseWarpTile(large, size, M, params);
+		printf("    tiles %dx%d", tile.width, tile.height);
+		if (counters.Available())
+		{
+			printf(", L2 misses %.3f -> %.3f per pixel (%+.1f%%), LLC misses %.3f -> %.3f per pixel",
+				(double)counts[0][0] / size.area(), (double)counts[1][0] / size.area(),
+				counts[0][0] ? ((double)counts[1][0] / counts[0][0] - 1.) * 100. : 0.,
+				(double)counts[0][1] / size.area(), (double)counts[1][1] / size.area());
+		}
+		printf("\n");
+	}
+}
+
+// The default backend from 1 to all cores, checks the output never changes
+void BenchScaling(const Mat& src, const Mat& M, Size size)
+{
+	Mat single(size, src.type());
+	Mat dest(size, src.type());
+
+	cout << "Scaling, input " << src.cols << "x" << src.rows << ", output " << size.width << "x" << size.height << "\n";
+	for (int threads = 1; threads <= getNumberOfCPUs(); ++threads)
+	{
+		char name[64];
+		sprintf(name, "warp simd, %d threads", threads);
+		BenchResult r = Measure(name, src.size(), size, 1, [&](WarpStats* stats)
+		{
+			WarpParams params;
+			params.numThreads = threads;
+			params.stats = stats;
+			WarpImg(src, dest, M, params);
+		});
+
+		// max error against the single thread output here
+		if (threads == 1)
+		{
+			dest.copyTo(single);
+		}
+		r.maxErr = norm(dest, single, NORM_INF);
+		Report(r);
+	}
+}
+
+// Fills dir with count 1080p P6 frames panning across a 4x upscale of the
+// court, named frame00000.ppm on. Returns false when one cannot be written.
+bool MakeFrames(const Mat& src, const string& dir, int count)
+{
+	Mat large;
+	resize(src, large, Size(src.cols * 4, src.rows * 4), 0, 0, INTER_LINEAR);
+	Size size(1920, 1080);
+	int panX = large.cols - size.width + 1, panY = large.rows - size.height + 1;
+
+	MappedImage file;
+	for (int f = 0; f < count; ++f)
+	{
+		char name[32];
+		sprintf(name, "/frame%05d.ppm", f);
+		if (!file.Create(dir + name, size, CV_8UC3))
+		{
+			return false;
+		}
+		cvtColor(large(Rect(Point((f / 2) % panX, (120 + f) % panY), size)), file.Image(), COLOR_BGR2RGB);
+	}
+	return true;
+}
+
+// Reports a single timed pass over frames files of size and channels
+void ReportPass(const string& name, Size size, int channels, int frames, int64 ticks)
+{
+	BenchResult r;
+	r.name = name;
+	r.input = size;
+	r.output = size;
+	r.frames = frames;
+	r.minMs = r.medianMs = r.p99Ms = ticks * 1000. / getTickFrequency();
+	r.mps = (double)size.area() * frames / (r.medianMs * 1000.);
+	r.maxErr = -1;
+	Report(r);
+	printf("    %.0f frames/s, %.0f MB/s\n", frames * 1000. / r.medianMs, r.mps * channels);
+}
+
+// imread against MappedImage::Open over the P6/P5 frames of dir, summing
+// every frame so the pixels are actually touched, then imwrite against
+// MappedImage::Create into outDir when it is given. A single pass each:
+// the mapped reads run first, so when dir does not fit in the page cache
+// they are the ones paying for the disk. Returns 1 when the two readers
+// disagree on the pixels.
+int BenchFrameIO(const string& dir, const string& outDir)
+{
+	vector<String> paths;
+	glob(dir + "/*.p?m", paths, false);
+	if (paths.empty())
+	{
+		printf("  no P6/P5 frames in %s\n", dir.c_str());
+		return 1;
+	}
+
+	MappedImage mapped;
+	if (!mapped.Open(paths[0]))
+	{
+		printf("  %s is not a P6/P5 file with 8-bit samples\n", paths[0].c_str());
+		return 1;
+	}
+	Size size = mapped.Image().size();
+	int channels = mapped.Image().channels();
+	int frames = (int)paths.size();
+	cout << "Frame I/O, " << frames << " frames of " << size.width << "x" << size.height << " in " << dir << "\n";
+
+	// the sums of all channels do not depend on their order, BGR or RGB
+	double mappedSum = 0, readSum = 0;
+	int64 start = getTickCount();
+	for (int f = 0; f < frames; ++f)
+	{
+		if (mapped.Open(paths[f]))
+		{
+			Scalar s = sum(mapped.Image());
+			mappedSum += s[0] + s[1] + s[2];
+		}
+	}
+	ReportPass("read mapped", size, channels, frames, getTickCount() - start);
+
+	Mat frame;
+	start = getTickCount();
+	for (int f = 0; f < frames; ++f)
+	{
+		frame = imread(paths[f], -1);
+		if (frame.data)
+		{
+			Scalar s = sum(frame);
+			readSum += s[0] + s[1] + s[2];
+		}
+	}
+	ReportPass("read imread", size, channels, frames, getTickCount() - start);
+
+	bool pass = mappedSum == readSum;
+	printf("    pixel sums %.0f mapped, %.0f imread  %s\n", mappedSum, readSum, pass ? "pass" : "FAIL");
+	if (outDir.empty() || !frame.data)
+	{
+		return !pass;
+	}
+
+	// the last frame written under the name of every frame, in the RGB order
+	// of a PPM as imwrite writes it
+	mapped.Close();
+	start = getTickCount();
+	for (int f = 0; f < frames; ++f)
+	{
+		string name = outDir + "/" + paths[f].substr(paths[f].find_last_of("/\\") + 1);
+		if (!mapped.Create(name, frame.size(), frame.type()))
+		{
+			continue;
+		}
+		if (frame.channels() == 3)
+		{
+			cvtColor(frame, mapped.Image(), COLOR_BGR2RGB);
+		}
+		else
+		{
+			frame.copyTo(mapped.Image());
+		}
+	}
+	mapped.Close();
+	ReportPass("write mapped", size, channels, frames, getTickCount() - start);
+
+	start = getTickCount();
+	for (int f = 0; f < frames; ++f)
+	{
+		imwrite(outDir + "/" + paths[f].substr(paths[f].find_last_of("/\\") + 1), frame);
+	}
+	ReportPass("write imwrite", size, channels, frames, getTickCount() - start);
+	return !pass;
+}
+
+// imread -> WarpImg one frame after the other, as main does, against the
+// same warps fed by a FrameLoader, over the frames of dir. The warp
+// rectifies a trapezoid of each frame into size.
+void BenchLoader(const string& dir, Size size, const FrameLoaderParams& params)
+{
+	vector<String> found;
+	glob(dir + "/*.p?m", found, false);
+	vector<string> paths(found.begin(), found.end());
+	if (paths.empty())
+	{
+		return;
+	}
+	int frames = (int)paths.size();
+
+	Mat frame = imread(paths[0], IMREAD_COLOR);
+	if (!frame.data)
+	{
+		return;
+	}
+	Point2f quad[4] = { Point2f(0, frame.rows - 1.f), Point2f(frame.cols * 0.1f, 0),
+		Point2f(frame.cols * 0.9f, 0), Point2f(frame.cols - 1.f, frame.rows - 1.f) };
+	Point2f corners[4] = { Point2f(0, size.height - 1.f), Point2f(0, 0),
+		Point2f(size.width - 1.f, 0), Point2f(size.width - 1.f, size.height - 1.f) };
+	Mat M = getPerspectiveTransform(quad, corners);
+	Mat dest(size, CV_8UC3);
+
+	cout << "Loader, " << frames << " frames of " << frame.cols << "x" << frame.rows << " in " << dir << ", "
+		<< params.threads << " decode threads, depth " << params.depth << "\n";
+	int64 start = getTickCount();
+	for (int f = 0; f < frames; ++f)
+	{
+		frame = imread(paths[f], IMREAD_COLOR);
+		if (frame.data)
+		{
+			WarpImg(frame, dest, M);
+		}
+	}
+	double serialMs = (getTickCount() - start) * 1000. / getTickFrequency();
+
+	int64 warpTicks = 0;
+	start = getTickCount();
+	FrameLoader loader(paths, params);
+	while (loader.Next(frame))
+	{
+		int64 warpStart = getTickCount();
+		if (frame.data)
+		{
+			WarpImg(frame, dest, M);
+		}
+		warpTicks += getTickCount() - warpStart;
+	}
+	double loaderMs = (getTickCount() - start) * 1000. / getTickFrequency();
+
+	FrameLoaderStats stats = loader.GetStats();
+	double msPerTick = 1000. / getTickFrequency();
+	printf("  serial %8.1f fps, loader %8.1f fps (%.2fx)\n", frames * 1000. / serialMs, frames * 1000. / loaderMs,
+		serialMs / loaderMs);
+	printf("    warp %.1f ms, waiting on decode %.1f ms; decode %.1f ms over %d threads, waiting for a slot %.1f ms\n",
+		warpTicks * msPerTick, stats.consumerStalls * msPerTick, stats.decodeTicks * msPerTick, params.threads,
+		stats.decodeStalls * msPerTick);
+}
+
+// The rectified court written count times into dir in every FrameWriter
+// format: how long the producer spent in Write against how long the files
+// took to land, and their size. Returns the formats whose first file imread
+// does not give back as written, jpeg within JPEG_MIN_PSNR.
+int BenchWriter(const Mat& src, const Mat& M, Size size, const string& dir, int count)
+{
+	Mat dest(size, src.type());
+	WarpImg(src, dest, M);
+
+	int failures = 0;
+	cout << "Writer, " << count << " frames of " << size.width << "x" << size.height << " into " << dir << "\n";
+	const char* names[5] = { "bmp", "png level 1", "png level 6", "jpeg quality 95", "raw" };
+	int formats[5] = { FRAME_BMP, FRAME_PNG, FRAME_PNG, FRAME_JPEG, FRAME_RAW };
+	int levels[5] = { 0, 1, 6, 0, 0 };
+	for (int i = 0; i < 5; ++i)
+	{
+		FrameWriterParams params;
+		params.format = formats[i];
+		params.pngCompression = levels[i];
+		FrameWriterStats stats;
+		int64 start = getTickCount(), submitTicks;
+		{
+			FrameWriter writer(params);
+			for (int f = 0; f < count; ++f)
+			{
+				char name[32];
+				sprintf(name, "/out%05d", f);
+				writer.Write(dir + name + FrameWriter::Extension(params.format, dest.channels()), dest);
+			}
+			submitTicks = getTickCount() - start;
+			writer.Flush();
+			stats = writer.GetStats();
+		}
+		double ms = (getTickCount() - start) * 1000. / getTickFrequency();
+		printf("  %-16s %8.1f frames/s %8.1f MB/s %8.1f KB/frame, producer %.3f ms/frame%s\n", names[i],
+			count * 1000. / ms, stats.BytesPerSecond() * 1e-6, stats.bytes / 1024. / max(stats.frames, (int64)1),
+			submitTicks * 1000. / getTickFrequency() / count, stats.failures ? ", write failures" : "");
+
+		// imread gives back the frame, in BGR order whatever the file stores
+		Mat back = imread(dir + "/out00000" + FrameWriter::Extension(params.format, dest.channels()), IMREAD_UNCHANGED);
+		bool readable = back.size() == dest.size() && back.type() == dest.type();
+		double psnr = readable ? PSNR(back, dest) : 0.;
+		bool pass = readable && (formats[i] == FRAME_JPEG ? psnr >= JPEG_MIN_PSNR : norm(back, dest, NORM_INF) == 0);
+		printf("    read back: %s  %s\n", !readable ? "unreadable" : formats[i] == FRAME_JPEG ?
+			format("%.1f dB", psnr).c_str() : pass ? "identical" : "differs", pass ? "pass" : "FAIL");
+		failures += !pass || stats.failures;
+	}
+	return failures;
+}
+
+// One backend configuration the accuracy gates run
+struct AccuracyCase
+{
+	const char* name;
+	int interpolation;
+	int mapMode;
+	bool fixedPoint;
+	int path; // 0 WarpImg, 1 WarpMapCache, 2 WarpBatch
+};
+
+// Runs every backend on the court and on homographies - 1 random quads
+// around it, compares each with warpPerspective. Returns the failed gates.
+int CheckAccuracy(const Mat& src, int homographies)
+{
+	const AccuracyCase cases[] = {
+		{ "linear scalar", INTER_LINEAR, WARP_MAP_SCALAR, true, 0 },
+		{ "linear simd", INTER_LINEAR, WARP_MAP_SIMD, true, 0 },
+		{ "linear incremental", INTER_LINEAR, WARP_MAP_INCREMENTAL, true, 0 },
+		{ "linear simd, float blend", INTER_LINEAR, WARP_MAP_SIMD, false, 0 },
+		{ "linear cached maps", INTER_LINEAR, WARP_MAP_SIMD, true, 1 },
+		{ "linear batch", INTER_LINEAR, WARP_MAP_SIMD, true, 2 },
+		{ "nearest scalar", INTER_NEAREST, WARP_MAP_SCALAR, true, 0 },
+		{ "nearest simd", INTER_NEAREST, WARP_MAP_SIMD, true, 0 },
+		{ "nearest incremental", INTER_NEAREST, WARP_MAP_INCREMENTAL, true, 0 },
+		{ "cubic simd", INTER_CUBIC, WARP_MAP_SIMD, true, 0 },
+		{ "lanczos4 simd", INTER_LANCZOS4, WARP_MAP_SIMD, true, 0 },
+	};
+	const int caseCount = sizeof(cases) / sizeof(cases[0]);
+	vector<double> maxErr(caseCount, 0.), minPsnr(caseCount, DBL_MAX);
+
+	Size size(TARGET_COL, TARGET_ROW);
+	Point2f corners[4] = { Point2f(0, 0), Point2f(size.width - 1.f, 0),
+		Point2f(size.width - 1.f, size.height - 1.f), Point2f(0, size.height - 1.f) };
+	RNG rng(0x5eed);
+	WarpMapCache cache;
+	vector<Mat> srcs(1, src), dests;
+	Mat reference, dest(size, src.type());
+
+	for (int h = 0; h < homographies; ++h)
+	{
+		// the first one is the picked court, the others move each corner up
+		// to 40 pixels, which also pushes parts of the output off the image
+		Point2f quad[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			quad[i] = gDistortPts[i];
+			if (h > 0)
+			{
+				quad[i] += Point2f(rng.uniform(-40.f, 40.f), rng.uniform(-40.f, 40.f));
+			}
+		}
+		Mat M = getPerspectiveTransform(quad, corners);
+
+		for (int c = 0; c < caseCount; ++c)
+		{
+			WarpParams params;
+			params.interpolation = cases[c].interpolation;
+			params.mapMode = cases[c].mapMode;
+			params.fixedPoint = cases[c].fixedPoint;
+
+			warpPerspective(src, reference, M, size, cases[c].interpolation, BORDER_CONSTANT);
+			if (cases[c].path == 0)
+			{
+				WarpImg(src, dest, M, params);
+			}
+			else if (cases[c].path == 1)
+			{
+				cache.Warp(src, dest, M, params);
+			}
+			else
+			{
+				WarpBatch(srcs, dests, M, size, params);
+				dest = dests[0];
+			}
+
+			maxErr[c] = max(maxErr[c], norm(dest, reference, NORM_INF));
+			minPsnr[c] = min(minPsnr[c], PSNR(dest, reference));
+		}
+	}
+
+	int failures = 0;
+	cout << "Accuracy against warpPerspective, " << homographies << " homographies\n";
+	for (int c = 0; c < caseCount; ++c)
+	{
+		int interpolation = cases[c].interpolation;
+		bool pass = interpolation == INTER_LINEAR ? maxErr[c] <= LINEAR_MAX_ERROR && minPsnr[c] >= LINEAR_MIN_PSNR :
+			interpolation == INTER_NEAREST ? minPsnr[c] >= NEAREST_MIN_PSNR :
+			maxErr[c] <= KERNEL_MAX_ERROR && minPsnr[c] >= KERNEL_MIN_PSNR;
+		failures += !pass;
+		printf("  %-24s max error %3g  min PSNR %6.1f dB  %s\n", cases[c].name, maxErr[c], minPsnr[c], pass ? "pass" : "FAIL");
+	}
+	return failures;
+}
+
+// Median MP/s per case of a --json file, keyed by name and output size
+map<string, double> ReadBaseline(const string& path)
+{
+	map<string, double> baseline;
+	ifstream in(path.c_str());
+	string line;
+
+	// WriteJson puts one result per line
+	while (getline(in, line))
+	{
+		size_t name = line.find("\"name\": \"");
+		size_t output = line.find("\"output\": [");
+		size_t mps = line.find("\"mp_per_s\": ");
+		if (name == string::npos || output == string::npos || mps == string::npos)
+		{
+			continue;
+		}
+		name += 9;
+		output += 11;
+		string key = line.substr(name, line.find('"', name) - name) + " " +
+			to_string(atoi(line.c_str() + output)) + "x" + to_string(atoi(line.c_str() + line.find(',', output) + 1));
+		baseline[key] = atof(line.c_str() + mps + 12);
+	}
+	return baseline;
+}
+
+// Compares the measured throughput with the baseline, returns the cases that
+// lost more than tolerance percent. Cases missing from the baseline are new.
+int CheckBaseline(const map<string, double>& baseline, double tolerance)
+{
+	int failures = 0;
+	cout << "Throughput against baseline, " << tolerance << "% tolerance\n";
+	for (size_t i = 0; i < gResults.size(); ++i)
+	{
+		const BenchResult& r = gResults[i];
+		string key = r.name + " " + to_string(r.output.width) + "x" + to_string(r.output.height);
+		map<string, double>::const_iterator it = baseline.find(key);
+		if (it == baseline.end())
+		{
+			continue;
+		}
+
+		double change = (r.mps / it->second - 1.) * 100.;
+		bool pass = change >= -tolerance;
+		failures += !pass;
+		printf("  %-36s %8.1f -> %8.1f MP/s  %+6.1f%%  %s\n", key.c_str(), it->second, r.mps, change, pass ? "pass" : "FAIL");
+	}
+	return failures;
+}
+
+int main(int argc, char** argv)
+{
+	const char* keys =
+		"{help h usage ? |                      | print this message }"
+		"{@image         | basketball-court.ppm | court image, the larger frames are upscaled from it }"
+		"{json           |                      | also write the results as JSON to this file }"
+		"{iterations     | 20                   | timed runs per case }"
+		"{warmup         | 3                    | untimed runs per case }"
+		"{check          |                      | gate every backend on accuracy against warpPerspective }"
+		"{homographies   | 50                   | court homographies --check runs, all but the first randomized }"
+		"{baseline       |                      | JSON of an earlier run, gate on throughput against it }"
+		"{tolerance      | 10                   | throughput loss against --baseline allowed, in percent }"
+		"{frames         |                      | directory of P6/P5 frames to time imread against MappedImage on }"
+		"{frames_out     |                      | existing directory to also time imwrite against MappedImage and FrameWriter into }"
+		"{make_frames    | 0                    | first fill --frames with this many 1080p P6 frames of the court }"
+		"{loader_threads | 2                    | decode threads of the FrameLoader timed on --frames }"
+		"{loader_depth   | 8                    | ring slots of that FrameLoader }";
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("Headless benchmark of ProcessImg, ProcessImgCV and the warp engine backends");
+	if (parser.has("help"))
+	{
+		parser.printMessage();
+		return 0;
+	}
+	string inputPath = parser.get<string>(0);
+	string jsonPath = parser.get<string>("json");
+	gIterations = parser.get<int>("iterations");
+	gWarmup = parser.get<int>("warmup");
+	bool check = parser.has("check");
+	int homographies = parser.get<int>("homographies");
+	string baselinePath = parser.get<string>("baseline");
+	double tolerance = parser.get<double>("tolerance");
+	string framesDir = parser.get<string>("frames");
+	string framesOutDir = parser.get<string>("frames_out");
+	int makeFrames = parser.get<int>("make_frames");
+	FrameLoaderParams loaderParams;
+	loaderParams.threads = parser.get<int>("loader_threads");
+	loaderParams.depth = parser.get<int>("loader_depth");
+	if (!parser.check() || gIterations < 1 || gWarmup < 0 || homographies < 1 || makeFrames < 0
+		|| (makeFrames && framesDir.empty()) || loaderParams.threads < 1 || loaderParams.depth < 2)
+	{
+		parser.printErrors();
+		return -1;
+	}
+
+	Mat inputImg = imread(inputPath, -1);
+	if (!inputImg.data)
+	{
+		printf(" No image data \n ");
+		return -1;
+	}
+
+	map<string, double> baseline;
+	if (!baselinePath.empty())
+	{
+		baseline = ReadBaseline(baselinePath);
+		if (baseline.empty())
+		{
+			printf(" No results in %s \n ", baselinePath.c_str());
+			return -1;
+		}
+	}
+
+	vector<Point2f> pickPts(gCourtPts, gCourtPts + 4);
+	gDistortPts = pickPts;
+	InitOutputPts();
+
+	int failures = check ? CheckAccuracy(inputImg, homographies) : 0;
+
+	// the court as shot, then synthetic 2x and 4x frames with proportionally
+	// larger outputs, up to 3760x2000
+	Mat frame = inputImg;
+	for (int scale = 1; scale <= 4; scale *= 2)
+	{
+		if (scale > 1)
+		{
+			resize(inputImg, frame, Size(), scale, scale, INTER_LINEAR);
+		}
+		Size size(TARGET_COL * scale, TARGET_ROW * scale);
+		BenchFrame(frame, SetCourt(pickPts, (float)scale, size), size);
+	}
+
+	Size target(TARGET_COL, TARGET_ROW);
+	Mat M = SetCourt(pickPts, 1.f, target);
+	cout << "Batch, input " << inputImg.cols << "x" << inputImg.rows << ", output " << target.width << "x" << target.height << "\n";
+	int batchSizes[] = { 1, 8, 64 };
+	for (int i = 0; i < 3; ++i)
+	{
+		BenchBatch(inputImg, M, target, batchSizes[i]);
+	}
+
+	// frame still holds the 4x court
+	Size large(TARGET_COL * 4, TARGET_ROW * 4);
+	BenchScaling(frame, SetCourt(pickPts, 4.f, large), large);
+	BenchAntiAliasing(frame, 4.f, target);
+
+	SetCourt(pickPts, 1.f, target);
+	BenchTemporal(inputImg, target, 200);
+	BenchQuadSolver(4096);
+	int courtFailures = BenchCourt(inputImg, 60);
+	failures += check ? courtFailures : 0;
+	int mosaicFailures = BenchMosaic(inputImg);
+	failures += check ? mosaicFailures : 0;
+	int zeroCopyFailures = CheckZeroCopy(inputImg, M, target);
+	failures += check ? zeroCopyFailures : 0;
+	BenchTiled(inputImg, large);
+
+	if (!framesDir.empty())
+	{
+		if (makeFrames && !MakeFrames(inputImg, framesDir, makeFrames))
+		{
+			printf(" Could not write frames into %s \n ", framesDir.c_str());
+			return -1;
+		}
+		int ioFailures = BenchFrameIO(framesDir, framesOutDir);
+		failures += check ? ioFailures : 0;
+		BenchLoader(framesDir, target, loaderParams);
+		if (!framesOutDir.empty())
+		{
+			int writerFailures = BenchWriter(inputImg, M, target, framesOutDir, 200);
+			failures += check ? writerFailures : 0;
+		}
+	}
+
+	cout << "Homography estimation\n";
+	int pointCounts[] = { 100, 1000 };
+	double outlierRatios[] = { 0.2, 0.5 };
+	for (int i = 0; i < 2; ++i)
+	{
+		for (int j = 0; j < 2; ++j)
+		{
+			BenchHomography(M, pointCounts[i], outlierRatios[j]);
+		}
+	}
+
+	if (!jsonPath.empty() && !WriteJson(jsonPath))
+	{
+		printf(" Could not write %s \n ", jsonPath.c_str());
+		return -1;
+	}
+
+	if (!baseline.empty())
+	{
+		failures += CheckBaseline(baseline, tolerance);
+	}
+	if (failures)
+	{
+		printf("%d gates failed\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
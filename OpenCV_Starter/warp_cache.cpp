@@ -0,0 +1,197 @@
+#include "warp_cache.h"
+
+#include <cstring>                         // memcmp
+#include "homography.h"                    // SquareToQuad()
+
+using namespace cv;
+
+WarpCacheStats::WarpCacheStats()
+	: hits(0), misses(0), evictions(0), bytes(0), entries(0)
+{
+}
+
+// 64-bit FNV-1a
+static uint64 HashBytes(uint64 hash, const void* data, size_t size)
+{
+	const uchar* p = (const uchar*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static size_t MapBytes(const Mat& xy, const Mat& frac)
+{
+	return xy.total() * xy.elemSize() + frac.total() * frac.elemSize();
+}
+
+WarpMapCache::WarpMapCache(size_t maxBytes)
+	: maxBytes(maxBytes)
+{
+}
+
+void WarpMapCache::MakeKey(Entry& key, Size dsize, InputArray M, const WarpParams& params)
+{
+	Mat M0 = M.getMat();
+	CV_Assert(M0.rows == 3 && M0.cols == 3 && M0.channels() == 1);
+	Mat m(3, 3, CV_64F, key.m);
+	M0.convertTo(m, CV_64F);
+
+	// only what changes the maps is part of the key, border and blend
+	// settings are applied by the gather
+	key.dsize = dsize;
+	key.interpolation = params.interpolation;
+	key.mapMode = params.mapMode;
+	key.reanchorStep = params.mapMode == WARP_MAP_INCREMENTAL ? params.reanchorStep : 0;
+
+	uint64 hash = 14695981039346656037ULL;
+	hash = HashBytes(hash, key.m, sizeof(key.m));
+	hash = HashBytes(hash, &key.dsize, sizeof(key.dsize));
+	hash = HashBytes(hash, &key.interpolation, sizeof(key.interpolation));
+	hash = HashBytes(hash, &key.mapMode, sizeof(key.mapMode));
+	hash = HashBytes(hash, &key.reanchorStep, sizeof(key.reanchorStep));
+	key.hash = hash;
+}
+
+bool WarpMapCache::SameKey(const Entry& a, const Entry& b)
+{
+	return a.hash == b.hash && memcmp(a.m, b.m, sizeof(a.m)) == 0 && a.dsize == b.dsize &&
+		a.interpolation == b.interpolation && a.mapMode == b.mapMode && a.reanchorStep == b.reanchorStep;
+}
+
+void WarpMapCache::GetMaps(Size dsize, InputArray M, const WarpParams& params, Mat& xy, Mat& frac)
+{
+	Entry key;
+	MakeKey(key, dsize, M, params);
+
+	for (std::list<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (SameKey(*it, key))
+		{
+			++stats.hits;
+			entries.splice(entries.begin(), entries, it);
+			xy = it->xy;
+			frac = it->frac;
+			return;
+		}
+	}
+
+	++stats.misses;
+	BuildWarpMaps(dsize, M, params, key.xy, key.frac);
+	entries.push_front(key);
+	stats.bytes += MapBytes(key.xy, key.frac);
+
+	while (stats.bytes > maxBytes && entries.size() > 1)
+	{
+		stats.bytes -= MapBytes(entries.back().xy, entries.back().frac);
+		entries.pop_back();
+		++stats.evictions;
+	}
+
+	xy = key.xy;
+	frac = key.frac;
+}
+
+void WarpMapCache::Warp(const Mat& src, Mat& dest, InputArray M, const WarpParams& params)
+{
+	CV_Assert(!dest.empty());
+
+	Mat xy, frac;
+	GetMaps(dest.size(), M, params, xy, frac);
+	RemapImg(src, dest, xy, frac, params);
+}
+
+void WarpMapCache::Clear()
+{
+	entries.clear();
+	stats.bytes = 0;
+}
+
+WarpCacheStats WarpMapCache::GetStats() const
+{
+	WarpCacheStats ret = stats;
+	ret.entries = (int)entries.size();
+	return ret;
+}
+
+TemporalWarpStats::TemporalWarpStats()
+	: frames(0), rebuilds(0), corrections(0)
+{
+}
+
+TemporalWarp::TemporalWarp(double epsilon, bool correct)
+	: epsilon(epsilon), correct(correct), valid(false), interpolation(0), mapMode(0), reanchorStep(0)
+{
+}
+
+void TemporalWarp::Rebuild(const Point2f quad[4], Size dsize, const WarpParams& params)
+{
+	// target pixels -> unit square -> quad, the matrix GetProjMat makes
+	Matx33d H;
+	bool convex = SquareToQuad(quad, H);
+	CV_Assert(convex);
+	H = H * Matx33d(1. / (dsize.width - 1), 0, 0, 0, 1. / (dsize.height - 1), 0, 0, 0, 1);
+
+	WarpParams mapParams = params;
+	mapParams.interpolation |= WARP_INVERSE_MAP;
+	BuildWarpMaps(dsize, H, mapParams, xy, frac);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		builtQuad[i] = quad[i];
+	}
+	this->dsize = dsize;
+	interpolation = params.interpolation;
+	mapMode = params.mapMode;
+	reanchorStep = params.reanchorStep;
+	shift = Point();
+	valid = true;
+	++stats.rebuilds;
+}
+
+void TemporalWarp::Warp(const Mat& src, const Point2f quad[4], Mat& dest, const WarpParams& params)
+{
+	CV_Assert(!dest.empty() && !(params.interpolation & WARP_INVERSE_MAP));
+	++stats.frames;
+
+	double maxDisplacement = 0;
+	Point2f meanDisplacement;
+	for (int i = 0; valid && i < 4; ++i)
+	{
+		Point2f d = quad[i] - builtQuad[i];
+		maxDisplacement = std::max(maxDisplacement, norm(d));
+		meanDisplacement += d * 0.25f;
+	}
+
+	if (!valid || maxDisplacement > epsilon || dest.size() != dsize || params.interpolation != interpolation ||
+		params.mapMode != mapMode || params.reanchorStep != reanchorStep)
+	{
+		Rebuild(quad, dest.size(), params);
+	}
+	else if (correct)
+	{
+		int unit = interpolation == INTER_NEAREST ? 1 : INTER_TAB_SIZE;
+		Point target(cvRound(meanDisplacement.x * unit), cvRound(meanDisplacement.y * unit));
+		if (target != shift)
+		{
+			ShiftWarpMaps(xy, frac, target - shift);
+			shift = target;
+			++stats.corrections;
+		}
+	}
+
+	RemapImg(src, dest, xy, frac, params);
+}
+
+void TemporalWarp::Reset()
+{
+	valid = false;
+	xy.release();
+	frac.release();
+}
+
+TemporalWarpStats TemporalWarp::GetStats() const
+{
+	return stats;
+}
@@ -0,0 +1,114 @@
+#ifndef WARP_CACHE_H
+#define WARP_CACHE_H
+
+#include <list>                            // std::list
+#include <opencv2/core/core.hpp>           // cv::Mat
+#include "warp_engine.h"                   // WarpParams
+
+// Counters of a WarpMapCache
+struct WarpCacheStats
+{
+	int64 hits;      // lookups served from the cache
+	int64 misses;    // lookups that had to build maps
+	int64 evictions; // entries dropped to stay under the memory bound
+	size_t bytes;    // memory currently held by cached maps
+	int entries;     // maps currently cached
+
+	WarpCacheStats();
+};
+
+// LRU cache of warp maps keyed by homography, interpolation and output size.
+// With a fixed camera the homography repeats for thousands of frames, so the
+// map stage runs once and every later frame is a pure gather (RemapImg).
+// Not thread safe, use one cache per pipeline.
+class WarpMapCache
+{
+public:
+	// maxBytes bounds the memory held by cached maps; the most recently used
+	// entry is always kept, even when it alone is larger
+	explicit WarpMapCache(size_t maxBytes = 256 << 20);
+
+	// Same result as WarpImg(src, dest, M, params), dest must be allocated
+	void Warp(const cv::Mat& src, cv::Mat& dest, cv::InputArray M, const WarpParams& params = WarpParams());
+
+	// Maps of a dsize warp by M as BuildWarpMaps makes them, built on a miss.
+	// The returned Mats share data with the cache, do not write into them.
+	void GetMaps(cv::Size dsize, cv::InputArray M, const WarpParams& params, cv::Mat& xy, cv::Mat& frac);
+
+	void Clear();
+
+	WarpCacheStats GetStats() const;
+
+private:
+	struct Entry
+	{
+		uint64 hash;
+		double m[9];       // M as given
+		cv::Size dsize;
+		int interpolation; // including WARP_INVERSE_MAP
+		int mapMode;
+		int reanchorStep;
+		cv::Mat xy;
+		cv::Mat frac;
+	};
+
+	static void MakeKey(Entry& key, cv::Size dsize, cv::InputArray M, const WarpParams& params);
+	static bool SameKey(const Entry& a, const Entry& b);
+
+	std::list<Entry> entries; // most recently used first
+	size_t maxBytes;
+	WarpCacheStats stats;
+};
+
+// Counters of a TemporalWarp
+struct TemporalWarpStats
+{
+	int64 frames;      // Warp calls
+	int64 rebuilds;    // of those, building new maps
+	int64 corrections; // of the reusing ones, shifting the maps to follow the corners
+
+	TemporalWarpStats();
+
+	double RebuildRate() const { return frames ? (double)rebuilds / frames : 0.; }
+};
+
+// Rectifies a tracked quad frame after frame, keeping the maps of the
+// corners they were built for. While every corner stays within epsilon
+// source pixels of those, the maps are reused as they are; with correct set
+// they are first shifted by the mean corner displacement (ShiftWarpMaps),
+// which follows sub-pixel drift at a fraction of a rebuild. Past epsilon, or
+// when the output size or map settings change, the maps are built again.
+// Not thread safe, use one per tracked quad.
+class TemporalWarp
+{
+public:
+	explicit TemporalWarp(double epsilon = 0.25, bool correct = false);
+
+	// Rectifies quad of src (left bottom, left top, right top, right bottom,
+	// like gDistortPts) into dest, which must be allocated and sets the output
+	// size. params.interpolation must not have WARP_INVERSE_MAP.
+	void Warp(const cv::Mat& src, const cv::Point2f quad[4], cv::Mat& dest, const WarpParams& params = WarpParams());
+
+	// Forgets the maps, the next Warp rebuilds
+	void Reset();
+
+	TemporalWarpStats GetStats() const;
+
+private:
+	void Rebuild(const cv::Point2f quad[4], cv::Size dsize, const WarpParams& params);
+
+	double epsilon;
+	bool correct;
+	bool valid;
+	cv::Point2f builtQuad[4]; // corners the maps were built for
+	cv::Size dsize;
+	int interpolation;
+	int mapMode;
+	int reanchorStep;
+	cv::Point shift;          // applied to the maps so far, in map units
+	cv::Mat xy;
+	cv::Mat frac;
+	TemporalWarpStats stats;
+};
+
+#endif
@@ -0,0 +1,1618 @@
+#include "warp_engine.h"
+
+#include <algorithm>                       // std::sort
+#include <cfloat>                          // DBL_MAX, FLT_EPSILON
+#include <climits>                         // INT_MAX, INT_MIN, SHRT_MAX
+#include <cmath>                           // std::log, std::sin
+#include <cstring>                         // memcpy, memset
+#include <opencv2/hal/intrin.hpp>          // v_float32x4
+#include "homography.h"                    // SquareToQuad()
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>                     // _mm_prefetch
+#define PREFETCH_L2(p) _mm_prefetch((const char*)(p), _MM_HINT_T1)
+#elif defined(__GNUC__)
+#define PREFETCH_L2(p) __builtin_prefetch((p), 0, 2)
+#else
+#define PREFETCH_L2(p)
+#endif
+
+using namespace cv;
+
+// destination pixels per map/gather block, the maps of one block live on the stack
+#define BLOCK_SIZE 256
+
+// tiled warps
+#define CACHE_LINE 64
+#define TILE_MIN_ROWS 8   // however large the footprint, below this the tiles only add overhead
+#define TILE_SAMPLES 9    // per side of the destination grid the Jacobian is sampled on
+
+// fixed point bilinear weights, same precision as remap uses for 8-bit images
+#define INTER_REMAP_COEF_BITS 15
+#define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
+
+// Bilinear weights (top left, top right, bottom left, bottom right) for
+// every sub-pixel fraction index (fy << INTER_BITS) + fx of the map
+static short gBilinearTab[INTER_TAB_SIZE2][4];
+
+// Builds gBilinearTab the way remap builds its table for CV_16SC2 maps, so
+// both produce the same pixels from the same map
+static bool InitBilinearTab()
+{
+	for (int fy = 0; fy < INTER_TAB_SIZE; ++fy)
+	{
+		for (int fx = 0; fx < INTER_TAB_SIZE; ++fx)
+		{
+			float vy[2] = { 1.f - (float)fy / INTER_TAB_SIZE, (float)fy / INTER_TAB_SIZE };
+			float vx[2] = { 1.f - (float)fx / INTER_TAB_SIZE, (float)fx / INTER_TAB_SIZE };
+			short* w = gBilinearTab[fy * INTER_TAB_SIZE + fx];
+			int sum = 0;
+
+			for (int k = 0; k < 4; ++k)
+			{
+				sum += w[k] = saturate_cast<short>(vy[k >> 1] * vx[k & 1] * INTER_REMAP_COEF_SCALE);
+			}
+			// only fraction (0, 0) falls short, its full weight does not fit in
+			// a short; remap gives the missing unit to the bottom right weight
+			w[3] = (short)(w[3] + INTER_REMAP_COEF_SCALE - sum);
+		}
+	}
+	return true;
+}
+
+static bool gBilinearTabReady = InitBilinearTab();
+
+// fixed point horizontal weights of the wider kernels
+#define KERNEL_COEF_BITS 14
+#define KERNEL_COEF_SCALE (1 << KERNEL_COEF_BITS)
+
+// Separable bicubic and Lanczos-4 weights for each of the INTER_TAB_SIZE
+// fractions of the map, quantized once here instead of evaluating the kernel
+// per pixel. The horizontal taps use the short ones in pairs with v_dotprod,
+// the vertical taps the same weights as float.
+static short gCubicTab[INTER_TAB_SIZE][4];
+static float gCubicTabF[INTER_TAB_SIZE][4];
+static short gLanczos4Tab[INTER_TAB_SIZE][8];
+static float gLanczos4TabF[INTER_TAB_SIZE][8];
+
+// The kernels remap evaluates, taps x - 1 .. x + 2
+static void CubicCoeffs(float x, float* coeffs)
+{
+	const float A = -0.75f;
+	coeffs[0] = ((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A;
+	coeffs[1] = ((A + 2) * x - (A + 3)) * x * x + 1;
+	coeffs[2] = ((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1;
+	coeffs[3] = 1.f - coeffs[0] - coeffs[1] - coeffs[2];
+}
+
+// taps x - 3 .. x + 4, normalized to sum to 1
+static void Lanczos4Coeffs(float x, float* coeffs)
+{
+	if (x < FLT_EPSILON)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			coeffs[i] = 0;
+		}
+		coeffs[3] = 1;
+		return;
+	}
+
+	float sum = 0;
+	for (int i = 0; i < 8; ++i)
+	{
+		double t = (x + 3 - i) * CV_PI;
+		coeffs[i] = (float)(std::sin(t) * std::sin(t * 0.25) / (t * t));
+		sum += coeffs[i];
+	}
+	for (int i = 0; i < 8; ++i)
+	{
+		coeffs[i] /= sum;
+	}
+}
+
+// Quantizes the weights of each fraction so each set sums to exactly
+// KERNEL_COEF_SCALE, the rounding error going to the largest tap
+static void QuantizeKernel(void (*coeffs)(float, float*), int taps, short* tab, float* tabF)
+{
+	for (int f = 0; f < INTER_TAB_SIZE; ++f)
+	{
+		float w[8];
+		coeffs((float)f / INTER_TAB_SIZE, w);
+		short* q = tab + f * taps;
+		int sum = 0, largest = 0;
+
+		for (int k = 0; k < taps; ++k)
+		{
+			sum += q[k] = saturate_cast<short>(w[k] * KERNEL_COEF_SCALE);
+			largest = q[k] > q[largest] ? k : largest;
+		}
+		q[largest] = (short)(q[largest] + KERNEL_COEF_SCALE - sum);
+
+		for (int k = 0; k < taps; ++k)
+		{
+			tabF[f * taps + k] = (float)q[k] / KERNEL_COEF_SCALE;
+		}
+	}
+}
+
+static bool InitKernelTabs()
+{
+	QuantizeKernel(CubicCoeffs, 4, gCubicTab[0], gCubicTabF[0]);
+	QuantizeKernel(Lanczos4Coeffs, 8, gLanczos4Tab[0], gLanczos4TabF[0]);
+	return true;
+}
+
+static bool gKernelTabsReady = InitKernelTabs();
+
+WarpStats::WarpStats()
+	: rows(0), mapTicks(0), gatherTicks(0), pixels(0), covered(0)
+{
+}
+
+WarpParams::WarpParams()
+	: interpolation(INTER_LINEAR), borderMode(BORDER_CONSTANT), borderValue(),
+	mapMode(WARP_MAP_SIMD), reanchorStep(32), fixedPoint(true),
+	numThreads(0), stripeRows(16), cull(true), tiled(false), tileCacheBytes(256 * 1024), stats(0)
+{
+}
+
+MosaicRegion::MosaicRegion()
+{
+}
+
+MosaicRegion::MosaicRegion(const Point2f quad[4], Rect rect)
+	: rect(rect)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		this->quad[i] = quad[i];
+	}
+}
+
+// Inverts a row major 3x3 matrix, a singular matrix gives all zeros
+static void InvertMat33(const double* m, double* inv)
+{
+	double c0 = m[4] * m[8] - m[5] * m[7];
+	double c1 = m[5] * m[6] - m[3] * m[8];
+	double c2 = m[3] * m[7] - m[4] * m[6];
+	double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+	det = det != 0 ? 1. / det : 0.;
+
+	inv[0] = c0 * det;
+	inv[1] = (m[2] * m[7] - m[1] * m[8]) * det;
+	inv[2] = (m[1] * m[5] - m[2] * m[4]) * det;
+	inv[3] = c1 * det;
+	inv[4] = (m[0] * m[8] - m[2] * m[6]) * det;
+	inv[5] = (m[2] * m[3] - m[0] * m[5]) * det;
+	inv[6] = c2 * det;
+	inv[7] = (m[1] * m[6] - m[0] * m[7]) * det;
+	inv[8] = (m[0] * m[4] - m[1] * m[3]) * det;
+}
+
+// Loads M as doubles into m, turned into the destination -> source map
+static void LoadInverseMap(InputArray _M, int flags, double* m)
+{
+	Mat M0 = _M.getMat();
+	CV_Assert(M0.rows == 3 && M0.cols == 3 && M0.channels() == 1);
+
+	double buf[9];
+	Mat M(3, 3, CV_64F, (flags & WARP_INVERSE_MAP) ? m : buf);
+	M0.convertTo(M, CV_64F);
+
+	if (!(flags & WARP_INVERSE_MAP))
+	{
+		InvertMat33(buf, m);
+	}
+}
+
+// Per call constants of the map stage
+struct MapContext
+{
+	double m[9];      // destination -> source
+	int bits;         // fractional bits of the map, 0 for nearest
+	int reanchorStep; // WARP_MAP_INCREMENTAL: pixels between exact evaluations
+};
+
+// Source coordinates of count destination pixels starting at (x0, y), as
+// fixed point with ctx.bits fractional bits: XY gets the integer part and A,
+// when given, the fraction index (fy << bits) + fx. Rounding and clamping
+// follow warpPerspective, so the result is the map it would pass to remap.
+typedef void (*MapRowFunc)(const MapContext& ctx, int x0, int y, int count, short* XY, ushort* A);
+
+static void MapRowScalar(const MapContext& ctx, int x0, int y, int count, short* XY, ushort* A)
+{
+	const double* m = ctx.m;
+	const int bits = ctx.bits;
+	const double scale = (double)(1 << bits);
+	const int mask = (1 << bits) - 1;
+
+	for (int i = 0; i < count; ++i)
+	{
+		int x = x0 + i;
+		double W = m[6] * x + m[7] * y + m[8];
+		W = W ? scale / W : 0;
+		double fX = std::max((double)INT_MIN, std::min((double)INT_MAX, (m[0] * x + m[1] * y + m[2]) * W));
+		double fY = std::max((double)INT_MIN, std::min((double)INT_MAX, (m[3] * x + m[4] * y + m[5]) * W));
+		int X = saturate_cast<int>(fX);
+		int Y = saturate_cast<int>(fY);
+
+		XY[i * 2] = saturate_cast<short>(X >> bits);
+		XY[i * 2 + 1] = saturate_cast<short>(Y >> bits);
+		if (A)
+		{
+			A[i] = (ushort)(((Y & mask) << bits) + (X & mask));
+		}
+	}
+}
+
+static void MapRowSIMD(const MapContext& ctx, int x0, int y, int count, short* XY, ushort* A)
+{
+	int i = 0;
+#if CV_SIMD128
+	const double* m = ctx.m;
+	const int bits = ctx.bits;
+	const v_float32x4 vM0 = v_setall_f32((float)m[0]);
+	const v_float32x4 vM3 = v_setall_f32((float)m[3]);
+	const v_float32x4 vM6 = v_setall_f32((float)m[6]);
+	const v_float32x4 vX0 = v_setall_f32((float)(m[1] * y + m[2]));
+	const v_float32x4 vY0 = v_setall_f32((float)(m[4] * y + m[5]));
+	const v_float32x4 vW0 = v_setall_f32((float)(m[7] * y + m[8]));
+	const v_float32x4 vScale = v_setall_f32((float)(1 << bits));
+	const v_float32x4 vZero = v_setzero_f32();
+	// v_round has no saturation, anything this far is outside the source anyway
+	const v_float32x4 vMax = v_setall_f32((float)(1 << 30));
+	const v_float32x4 vMin = v_setall_f32(-(float)(1 << 30));
+	const v_float32x4 vStep = v_setall_f32(4.f);
+	const v_int32x4 vMask = v_setall_s32((1 << bits) - 1);
+	v_float32x4 vx((float)x0, (float)(x0 + 1), (float)(x0 + 2), (float)(x0 + 3));
+
+	for (; i <= count - 8; i += 8)
+	{
+		v_int32x4 X[2], Y[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			v_float32x4 W = v_muladd(vM6, vx, vW0);
+			W = v_select(W == vZero, vZero, vScale / W);
+			v_float32x4 fX = v_min(vMax, v_max(vMin, v_muladd(vM0, vx, vX0) * W));
+			v_float32x4 fY = v_min(vMax, v_max(vMin, v_muladd(vM3, vx, vY0) * W));
+			X[k] = v_round(fX);
+			Y[k] = v_round(fY);
+			vx += vStep;
+		}
+
+		v_int16x8 xy0, xy1;
+		v_zip(v_pack(X[0] >> bits, X[1] >> bits), v_pack(Y[0] >> bits, Y[1] >> bits), xy0, xy1);
+		v_store(XY + i * 2, xy0);
+		v_store(XY + i * 2 + 8, xy1);
+
+		if (A)
+		{
+			v_int32x4 a0 = ((Y[0] & vMask) << bits) + (X[0] & vMask);
+			v_int32x4 a1 = ((Y[1] & vMask) << bits) + (X[1] & vMask);
+			v_store((short*)(A + i), v_pack(a0, a1));
+		}
+	}
+#endif
+	MapRowScalar(ctx, x0 + i, y, count - i, XY + i * 2, A ? A + i : 0);
+}
+
+// Numerators and denominator are affine in x along a row, so they are
+// stepped by one addition per pixel. Float accumulation drifts, so they are
+// evaluated exactly again every reanchorStep pixels.
+static void MapRowIncremental(const MapContext& ctx, int x0, int y, int count, short* XY, ushort* A)
+{
+	const double* m = ctx.m;
+	const int bits = ctx.bits;
+	const float scale = (float)(1 << bits);
+	const int mask = (1 << bits) - 1;
+	const float dX = (float)m[0], dY = (float)m[3], dW = (float)m[6];
+	const float maxCoord = (float)(1 << 30);
+
+	for (int i = 0; i < count; )
+	{
+		int x = x0 + i;
+		float X = (float)(m[0] * x + m[1] * y + m[2]);
+		float Y = (float)(m[3] * x + m[4] * y + m[5]);
+		float W = (float)(m[6] * x + m[7] * y + m[8]);
+		int end = std::min(count, i + ctx.reanchorStep);
+
+		for (; i < end; ++i, X += dX, Y += dY, W += dW)
+		{
+			float invW = W ? scale / W : 0.f;
+			int IX = cvRound(std::max(-maxCoord, std::min(maxCoord, X * invW)));
+			int IY = cvRound(std::max(-maxCoord, std::min(maxCoord, Y * invW)));
+
+			XY[i * 2] = saturate_cast<short>(IX >> bits);
+			XY[i * 2 + 1] = saturate_cast<short>(IY >> bits);
+			if (A)
+			{
+				A[i] = (ushort)(((IY & mask) << bits) + (IX & mask));
+			}
+		}
+	}
+}
+
+// Source pixel at (x, y) after border extrapolation, 0 means the border value
+static inline const uchar* SrcPixel(const Mat& src, int x, int y, int borderMode)
+{
+	if ((unsigned)x >= (unsigned)src.cols || (unsigned)y >= (unsigned)src.rows)
+	{
+		if (borderMode == BORDER_CONSTANT || borderMode == BORDER_TRANSPARENT)
+		{
+			return 0;
+		}
+		x = borderInterpolate(x, src.cols, borderMode);
+		y = borderInterpolate(y, src.rows, borderMode);
+	}
+	return src.ptr(y) + x * src.elemSize();
+}
+
+static void GatherNearest(const Mat& src, uchar* D, const short* XY, int count, int borderMode, const uchar* cval)
+{
+	const int cn = src.channels();
+
+	for (int i = 0; i < count; ++i, D += cn)
+	{
+		const uchar* S = SrcPixel(src, XY[i * 2], XY[i * 2 + 1], borderMode);
+		if (!S && borderMode == BORDER_TRANSPARENT)
+		{
+			continue;
+		}
+		if (!S)
+		{
+			S = cval;
+		}
+		for (int c = 0; c < cn; ++c)
+		{
+			D[c] = S[c];
+		}
+	}
+}
+
+static void GatherLinear(const Mat& src, uchar* D, const short* XY, const ushort* A, int count, int borderMode, const uchar* cval)
+{
+	const int cn = src.channels();
+	const float fracScale = 1.f / INTER_TAB_SIZE;
+
+	for (int i = 0; i < count; ++i, D += cn)
+	{
+		int ix = XY[i * 2], iy = XY[i * 2 + 1];
+		float ax = (A[i] & (INTER_TAB_SIZE - 1)) * fracScale;
+		float ay = (A[i] >> INTER_BITS) * fracScale;
+		const uchar *S00, *S01, *S10, *S11;
+
+		if ((unsigned)ix < (unsigned)(src.cols - 1) && (unsigned)iy < (unsigned)(src.rows - 1))
+		{
+			S00 = src.ptr(iy) + ix * cn;
+			S01 = S00 + cn;
+			S10 = S00 + src.step;
+			S11 = S10 + cn;
+		}
+		else
+		{
+			if (borderMode == BORDER_TRANSPARENT)
+			{
+				continue;
+			}
+			S00 = SrcPixel(src, ix, iy, borderMode);
+			S01 = SrcPixel(src, ix + 1, iy, borderMode);
+			S10 = SrcPixel(src, ix, iy + 1, borderMode);
+			S11 = SrcPixel(src, ix + 1, iy + 1, borderMode);
+			S00 = S00 ? S00 : cval;
+			S01 = S01 ? S01 : cval;
+			S10 = S10 ? S10 : cval;
+			S11 = S11 ? S11 : cval;
+		}
+
+		for (int c = 0; c < cn; ++c)
+		{
+			float top = S00[c] + (S01[c] - S00[c]) * ax;
+			float bottom = S10[c] + (S11[c] - S10[c]) * ax;
+			D[c] = saturate_cast<uchar>(top + (bottom - top) * ay);
+		}
+	}
+}
+
+// Blends one pixel from its top (S0) and bottom (S1) tap pairs with the
+// 16-bit weights w, exactly as remap does: (sum + 2^14) >> 15
+static inline void BlendFixed(const uchar* S00, const uchar* S01, const uchar* S10, const uchar* S11,
+	const short* w, int cn, uchar* D)
+{
+	for (int c = 0; c < cn; ++c)
+	{
+		int sum = S00[c] * w[0] + S01[c] * w[1] + S10[c] * w[2] + S11[c] * w[3];
+		D[c] = saturate_cast<uchar>((sum + (1 << (INTER_REMAP_COEF_BITS - 1))) >> INTER_REMAP_COEF_BITS);
+	}
+}
+
+static void GatherLinearFixed(const Mat& src, uchar* D, const short* XY, const ushort* A, int count, int borderMode, const uchar* cval)
+{
+	const int cn = src.channels();
+	const size_t step = src.step;
+#if CV_SIMD128
+	// each row pair is fetched with two 8 byte loads starting at the left and
+	// the right tap, so the right tap needs 8 readable bytes inside its row
+	const int simdCols = std::max(src.cols - (8 + cn - 1) / cn, 0);
+	const v_int32x4 vDelta = v_setall_s32(1 << (INTER_REMAP_COEF_BITS - 1));
+	uchar buf[16];
+#endif
+
+	for (int i = 0; i < count; ++i, D += cn)
+	{
+		int ix = XY[i * 2], iy = XY[i * 2 + 1];
+		const short* w = gBilinearTab[A[i]];
+
+#if CV_SIMD128
+		if ((unsigned)ix < (unsigned)simdCols && (unsigned)iy < (unsigned)(src.rows - 1))
+		{
+			const uchar* S0 = src.ptr(iy) + ix * cn;
+			const uchar* S1 = S0 + step;
+
+			// pair up left and right taps per channel: l0 r0 l1 r1 ...
+			v_uint8x16 t0, t1;
+			v_zip(v_load_halves(S0, S1), v_load_halves(S0 + cn, S1 + cn), t0, t1);
+			v_uint16x8 top, bottom, unused;
+			v_expand(t0, top, unused);
+			v_expand(t1, bottom, unused);
+
+			// one (w0, w1) or (w2, w3) pair per 32-bit lane
+			v_int16x8 w01 = v_reinterpret_as_s16(v_setall_s32(*(const int*)w));
+			v_int16x8 w23 = v_reinterpret_as_s16(v_setall_s32(*(const int*)(w + 2)));
+			v_int32x4 sum = v_dotprod(v_reinterpret_as_s16(top), w01) + v_dotprod(v_reinterpret_as_s16(bottom), w23);
+			sum = (sum + vDelta) >> INTER_REMAP_COEF_BITS;
+
+			v_int16x8 sum16 = v_pack(sum, sum);
+			v_store(buf, v_pack_u(sum16, sum16));
+			for (int c = 0; c < cn; ++c)
+			{
+				D[c] = buf[c];
+			}
+			continue;
+		}
+#endif
+		if ((unsigned)ix < (unsigned)(src.cols - 1) && (unsigned)iy < (unsigned)(src.rows - 1))
+		{
+			const uchar* S0 = src.ptr(iy) + ix * cn;
+			BlendFixed(S0, S0 + cn, S0 + step, S0 + step + cn, w, cn, D);
+			continue;
+		}
+		if (borderMode == BORDER_TRANSPARENT)
+		{
+			continue;
+		}
+
+		const uchar* S00 = SrcPixel(src, ix, iy, borderMode);
+		const uchar* S01 = SrcPixel(src, ix + 1, iy, borderMode);
+		const uchar* S10 = SrcPixel(src, ix, iy + 1, borderMode);
+		const uchar* S11 = SrcPixel(src, ix + 1, iy + 1, borderMode);
+		BlendFixed(S00 ? S00 : cval, S01 ? S01 : cval, S10 ? S10 : cval, S11 ? S11 : cval, w, cn, D);
+	}
+}
+
+// Bicubic (4 taps) or Lanczos-4 (8 taps) from the tables of InitKernelTabs:
+// each source row is reduced by the horizontal weights in 16-bit fixed
+// point, the row sums are then weighted vertically in float. The SIMD path
+// runs the horizontal taps two rows and two taps at a time with v_dotprod
+// and the vertical ones for all channels at once; it gives the same pixels
+// as the scalar path.
+template<int taps>
+static void GatherKernel(const Mat& src, uchar* D, const short* XY, const ushort* A, int count, int borderMode,
+	const uchar* cval, const short (*tab)[taps], const float (*tabF)[taps])
+{
+	const int cn = src.channels();
+	const size_t step = src.step;
+	const int left = taps / 2 - 1; // taps left of the mapped pixel, and above it
+	const int innerCols = std::max(src.cols - taps + 1, 0);
+	const int innerRows = std::max(src.rows - taps + 1, 0);
+	const float scale = 1.f / KERNEL_COEF_SCALE;
+#if CV_SIMD128
+	// tap pairs are fetched with 8 byte loads starting at each tap, so the
+	// last tap needs 8 readable bytes inside its row
+	const int simdCols = std::max(src.cols - (8 + cn - 1) / cn - taps + 2, 0);
+	const v_float32x4 vScale = v_setall_f32(scale);
+	uchar buf[16];
+#endif
+
+	for (int i = 0; i < count; ++i, D += cn)
+	{
+		int x0 = XY[i * 2] - left, y0 = XY[i * 2 + 1] - left;
+		const short* wx = tab[A[i] & (INTER_TAB_SIZE - 1)];
+		const float* wy = tabF[A[i] >> INTER_BITS];
+		bool inside = (unsigned)x0 < (unsigned)innerCols && (unsigned)y0 < (unsigned)innerRows;
+
+#if CV_SIMD128
+		if (inside && x0 < simdCols)
+		{
+			const uchar* S = src.ptr(y0) + x0 * cn;
+			v_float32x4 sum = v_setzero_f32();
+
+			for (int r = 0; r < taps; r += 2, S += step * 2)
+			{
+				v_int32x4 row0 = v_setzero_s32(), row1 = v_setzero_s32();
+				for (int k = 0; k < taps; k += 2)
+				{
+					// pair up the taps per channel: row r in t0, row r + 1 in t1
+					const uchar* T = S + k * cn;
+					v_uint8x16 t0, t1;
+					v_zip(v_load_halves(T, T + step), v_load_halves(T + cn, T + step + cn), t0, t1);
+					v_uint16x8 p0, p1, unused;
+					v_expand(t0, p0, unused);
+					v_expand(t1, p1, unused);
+
+					v_int16x8 w = v_reinterpret_as_s16(v_setall_s32(*(const int*)(wx + k)));
+					row0 += v_dotprod(v_reinterpret_as_s16(p0), w);
+					row1 += v_dotprod(v_reinterpret_as_s16(p1), w);
+				}
+				sum = v_muladd(v_cvt_f32(row0), v_setall_f32(wy[r]), sum);
+				sum = v_muladd(v_cvt_f32(row1), v_setall_f32(wy[r + 1]), sum);
+			}
+
+			v_int32x4 result = v_round(sum * vScale);
+			v_int16x8 result16 = v_pack(result, result);
+			v_store(buf, v_pack_u(result16, result16));
+			for (int c = 0; c < cn; ++c)
+			{
+				D[c] = buf[c];
+			}
+			continue;
+		}
+#endif
+		if (!inside && borderMode == BORDER_TRANSPARENT)
+		{
+			continue;
+		}
+
+		float sum[4] = { 0, 0, 0, 0 };
+		for (int r = 0; r < taps; ++r)
+		{
+			int rowSum[4] = { 0, 0, 0, 0 };
+			for (int k = 0; k < taps; ++k)
+			{
+				const uchar* P = inside ? src.ptr(y0 + r) + (x0 + k) * cn : SrcPixel(src, x0 + k, y0 + r, borderMode);
+				P = P ? P : cval;
+				for (int c = 0; c < cn; ++c)
+				{
+					rowSum[c] += P[c] * wx[k];
+				}
+			}
+			for (int c = 0; c < cn; ++c)
+			{
+				sum[c] += rowSum[c] * wy[r];
+			}
+		}
+		for (int c = 0; c < cn; ++c)
+		{
+			D[c] = saturate_cast<uchar>(sum[c] * scale);
+		}
+	}
+}
+
+// Everything the stripes of one warp share, read only. A job either maps
+// and gathers (WarpImg, WarpBatch), only maps into xyOut/fracOut
+// (BuildWarpMaps) or only gathers from xyMap/fracMap (RemapImg).
+struct WarpJob
+{
+	const Mat* src;     // frames of the same size and type, null when only building maps
+	Mat* dest;          // one per frame
+	int frames;
+	const Mat* xyMap;   // precomputed maps, null to compute them on the fly
+	const Mat* fracMap;
+	Mat* xyOut;         // where built maps go
+	Mat* fracOut;
+	Size dsize;
+	MapContext ctx;
+	MapRowFunc mapRow;
+	int borderMode;
+	uchar cval[4];
+	bool nearest;
+	int taps;           // kernel size of the gather: 1 nearest, 2 linear, 4 cubic, 8 Lanczos-4
+	bool fixedPoint;
+	bool cull;          // rows are processed only over the span CoveredSpan gives
+	Point2d quad[4];    // cull: source support projected into the destination, convex
+	int cullAlign;      // cull: spans are widened to this pixel grid inside a block
+	Size tile;          // destination tile, empty to walk whole rows in stripes
+
+	WarpJob() : src(0), dest(0), frames(1), xyMap(0), fracMap(0), xyOut(0), fracOut(0), mapRow(0), taps(2), cull(false), cullAlign(1) {}
+};
+
+// Projects the source rectangle into the destination for culling. It is grown
+// by the kernel footprint (a pixel for bilinear) and a pixel for the map
+// rounding, so every pixel left outside samples nothing but border. A homography whose
+// horizon cuts the rectangle does not give a convex quad, culling is skipped.
+static void InitCulling(WarpJob& job)
+{
+	double fwd[9];
+	InvertMat33(job.ctx.m, fwd);
+
+	int reach = std::max(job.taps, 2) / 2;
+	double x0 = -reach - 1., y0 = -reach - 1., x1 = job.src->cols + reach, y1 = job.src->rows + reach;
+	double corners[4][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+	int positive = 0;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		double x = corners[i][0], y = corners[i][1];
+		double W = fwd[6] * x + fwd[7] * y + fwd[8];
+		if (W == 0)
+		{
+			return;
+		}
+		positive += W > 0;
+		job.quad[i] = Point2d((fwd[0] * x + fwd[1] * y + fwd[2]) / W, (fwd[3] * x + fwd[4] * y + fwd[5]) / W);
+	}
+	job.cull = positive == 0 || positive == 4;
+
+	// the SIMD kernel rounds its 8 pixel groups in float and its tail in
+	// double, the incremental one drifts between re-anchors; keeping the span
+	// on their grid leaves every pixel bit-identical to an unculled warp
+	job.cullAlign = job.mapRow == MapRowSIMD ? 8 : job.mapRow == MapRowIncremental ? job.ctx.reanchorStep : 1;
+}
+
+// Destination pixels [x0, x1) of row y that the quad covers, padded by a pixel
+// against rounding and aligned to job.cullAlign. x0 == x1 when the row misses
+// the quad.
+static void CoveredSpan(const WarpJob& job, int y, int& x0, int& x1)
+{
+	double xmin = DBL_MAX, xmax = -DBL_MAX;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const Point2d& a = job.quad[i];
+		const Point2d& b = job.quad[(i + 1) & 3];
+		if ((y < a.y && y < b.y) || (y > a.y && y > b.y))
+		{
+			continue;
+		}
+		double xa = a.x, xb = b.x;
+		if (a.y != b.y)
+		{
+			xa = xb = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+		}
+		xmin = std::min(xmin, std::min(xa, xb));
+		xmax = std::max(xmax, std::max(xa, xb));
+	}
+
+	x0 = (int)std::max(0., std::min((double)job.dsize.width, std::floor(xmin) - 1));
+	x1 = (int)std::max(0., std::min((double)job.dsize.width, std::ceil(xmax) + 2));
+	if (x0 >= x1)
+	{
+		x0 = x1 = job.dsize.width;
+		return;
+	}
+
+	int align = job.cullAlign;
+	int block0 = x0 / BLOCK_SIZE * BLOCK_SIZE;
+	int block1 = (x1 - 1) / BLOCK_SIZE * BLOCK_SIZE;
+	x0 = block0 + (x0 - block0) / align * align;
+	x1 = std::min(block1 + (x1 - block1 + align - 1) / align * align, std::min(block1 + BLOCK_SIZE, job.dsize.width));
+}
+
+// Writes the border value over count pixels
+static void FillBorder(uchar* D, int count, int cn, const uchar* cval)
+{
+	bool uniform = true;
+	for (int c = 1; c < cn; ++c)
+	{
+		uniform = uniform && cval[c] == cval[0];
+	}
+
+	if (uniform)
+	{
+		memset(D, cval[0], (size_t)count * cn);
+		return;
+	}
+	for (int i = 0; i < count; ++i, D += cn)
+	{
+		for (int c = 0; c < cn; ++c)
+		{
+			D[c] = cval[c];
+		}
+	}
+}
+
+// Warps columns [x0, x1) of destination rows [y0, y1), adds the timings to
+// stats when given. x0 and x1 must be on the BLOCK_SIZE grid or the width.
+static void WarpRows(const WarpJob& job, int y0, int y1, int x0, int x1, WarpStats* stats)
+{
+	const int cn = job.src ? job.src->channels() : 0;
+	const int frames = job.src ? job.frames : 0;
+
+	short bufXY[BLOCK_SIZE * 2];
+	ushort bufA[BLOCK_SIZE];
+
+	for (int y = y0; y < y1; ++y)
+	{
+		int xs = x0, xe = x1;
+
+		if (job.cull)
+		{
+			CoveredSpan(job, y, xs, xe);
+			xs = std::min(std::max(xs, x0), x1);
+			xe = std::max(std::min(xe, x1), xs);
+			for (int f = 0; f < frames && job.borderMode == BORDER_CONSTANT; ++f)
+			{
+				uchar* D = job.dest[f].ptr<uchar>(y);
+				FillBorder(D + x0 * cn, xs - x0, cn, job.cval);
+				FillBorder(D + xe * cn, x1 - xe, cn, job.cval);
+			}
+		}
+		if (stats)
+		{
+			stats->covered += (int64)(xe - xs) * std::max(frames, 1);
+		}
+
+		// blocks stay on the BLOCK_SIZE grid whatever the span
+		for (int x = xs, next; x < xe; x = next)
+		{
+			next = std::min((x / BLOCK_SIZE + 1) * BLOCK_SIZE, xe);
+			int count = next - x;
+			const short* XY = bufXY;
+			const ushort* A = bufA;
+
+			int64 t0 = stats ? getCPUTickCount() : 0;
+			if (job.xyMap)
+			{
+				XY = job.xyMap->ptr<short>(y) + x * 2;
+				A = job.nearest ? 0 : job.fracMap->ptr<ushort>(y) + x;
+			}
+			else
+			{
+				short* outXY = job.xyOut ? job.xyOut->ptr<short>(y) + x * 2 : bufXY;
+				ushort* outA = job.nearest ? 0 : job.fracOut ? job.fracOut->ptr<ushort>(y) + x : bufA;
+				job.mapRow(job.ctx, x, y, count, outXY, outA);
+				XY = outXY;
+				A = outA;
+			}
+			int64 t1 = stats ? getCPUTickCount() : 0;
+
+			// the block's maps are still in L1 for every frame after the first
+			for (int f = 0; f < frames; ++f)
+			{
+				const Mat& src = job.src[f];
+				uchar* D = job.dest[f].ptr<uchar>(y) + x * cn;
+
+				if (job.nearest)
+				{
+					GatherNearest(src, D, XY, count, job.borderMode, job.cval);
+				}
+				else if (job.taps == 4)
+				{
+					GatherKernel<4>(src, D, XY, A, count, job.borderMode, job.cval, gCubicTab, gCubicTabF);
+				}
+				else if (job.taps == 8)
+				{
+					GatherKernel<8>(src, D, XY, A, count, job.borderMode, job.cval, gLanczos4Tab, gLanczos4TabF);
+				}
+				else if (job.fixedPoint)
+				{
+					GatherLinearFixed(src, D, XY, A, count, job.borderMode, job.cval);
+				}
+				else
+				{
+					GatherLinear(src, D, XY, A, count, job.borderMode, job.cval);
+				}
+			}
+
+			if (stats)
+			{
+				int64 t2 = getCPUTickCount();
+				stats->mapTicks += job.xyMap ? 0 : t1 - t0;
+				stats->gatherTicks += t2 - t1;
+			}
+		}
+	}
+
+	if (stats)
+	{
+		// a tiled row counts once, with its first tile
+		stats->rows += x0 == 0 ? (int64)(y1 - y0) * std::max(frames, 1) : 0;
+		stats->pixels += (int64)(y1 - y0) * (x1 - x0) * std::max(frames, 1);
+	}
+}
+
+// Adds the timings of one stripe to the totals of the call; lock is null
+// when the call runs on one thread
+static void AddStats(WarpStats& total, const WarpStats& local, Mutex* lock)
+{
+	if (!lock)
+	{
+		total.rows += local.rows;
+		total.mapTicks += local.mapTicks;
+		total.gatherTicks += local.gatherTicks;
+		total.pixels += local.pixels;
+		total.covered += local.covered;
+		return;
+	}
+
+	AutoLock guard(*lock);
+	total.rows += local.rows;
+	total.mapTicks += local.mapTicks;
+	total.gatherTicks += local.gatherTicks;
+	total.pixels += local.pixels;
+	total.covered += local.covered;
+}
+
+// Runs stripes of stripeRows destination rows through parallel_for_. Every
+// pixel is computed the same way whichever stripe and thread it lands in,
+// so the output is bit-identical for any thread count.
+class WarpInvoker : public ParallelLoopBody
+{
+public:
+	WarpInvoker(const WarpJob& job, int stripeRows, WarpStats* stats, Mutex* statsLock)
+		: job(job), stripeRows(stripeRows), stats(stats), statsLock(statsLock)
+	{
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		int y0 = range.start * stripeRows;
+		int y1 = std::min(range.end * stripeRows, job.dsize.height);
+
+		if (!stats)
+		{
+			WarpRows(job, y0, y1, 0, job.dsize.width, 0);
+			return;
+		}
+
+		WarpStats local;
+		WarpRows(job, y0, y1, 0, job.dsize.width, &local);
+		AddStats(*stats, local, statsLock);
+	}
+
+private:
+	const WarpJob& job;
+	int stripeRows;
+	WarpStats* stats;
+	Mutex* statsLock;
+};
+
+// Prefetches into L2 the source pixels destination tile area of job can
+// sample, the bounding box of its corners mapped into each frame
+static void PrefetchFootprint(const WarpJob& job, Rect area)
+{
+	const double* m = job.ctx.m;
+	double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		double u = i & 1 ? area.x + area.width : area.x;
+		double v = i & 2 ? area.y + area.height : area.y;
+		double W = m[6] * u + m[7] * v + m[8];
+		if (W <= 0)
+		{
+			// the tile crosses the horizon, its footprint is unbounded
+			return;
+		}
+		double X = (m[0] * u + m[1] * v + m[2]) / W, Y = (m[3] * u + m[4] * v + m[5]) / W;
+		xmin = std::min(xmin, X);
+		xmax = std::max(xmax, X);
+		ymin = std::min(ymin, Y);
+		ymax = std::max(ymax, Y);
+	}
+
+	const Mat& src0 = job.src[0];
+	int x0 = (int)std::max(0., std::floor(xmin) - 1), x1 = (int)std::min((double)src0.cols, std::ceil(xmax) + 2);
+	int y0 = (int)std::max(0., std::floor(ymin) - 1), y1 = (int)std::min((double)src0.rows, std::ceil(ymax) + 2);
+	const size_t pixelBytes = src0.elemSize();
+
+	for (int f = 0; f < job.frames; ++f)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const uchar* S = job.src[f].ptr<uchar>(y);
+			for (size_t b = x0 * pixelBytes; b < x1 * pixelBytes; b += CACHE_LINE)
+			{
+				PREFETCH_L2(S + b);
+			}
+		}
+	}
+}
+
+// Runs the tiles of job.tile size, in row major tile order; a tile's source
+// footprint is prefetched before it is warped
+class TileInvoker : public ParallelLoopBody
+{
+public:
+	TileInvoker(const WarpJob& job, WarpStats* stats, Mutex* statsLock)
+		: job(job), stats(stats), statsLock(statsLock)
+	{
+		tileCols = (job.dsize.width + job.tile.width - 1) / job.tile.width;
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		WarpStats local;
+		for (int t = range.start; t < range.end; ++t)
+		{
+			int x0 = t % tileCols * job.tile.width, y0 = t / tileCols * job.tile.height;
+			int x1 = std::min(x0 + job.tile.width, job.dsize.width), y1 = std::min(y0 + job.tile.height, job.dsize.height);
+			if (job.src)
+			{
+				PrefetchFootprint(job, Rect(x0, y0, x1 - x0, y1 - y0));
+			}
+			WarpRows(job, y0, y1, x0, x1, stats ? &local : 0);
+		}
+
+		if (stats)
+		{
+			AddStats(*stats, local, statsLock);
+		}
+	}
+
+private:
+	const WarpJob& job;
+	int tileCols;
+	WarpStats* stats;
+	Mutex* statsLock;
+};
+
+// Tile of dsize whose source footprint, at pixelBytes per pixel, fits in
+// cacheBytes; see ChooseWarpTile
+static Size ChooseTile(const MapContext& ctx, Size dsize, Size ssize, int pixelBytes, int cacheBytes)
+{
+	const double* m = ctx.m;
+
+	// largest source step per destination step, over a grid of destination
+	// points that land in the source: x and y of the source along u and v,
+	// and the area a destination pixel covers
+	double xu = 0, xv = 0, yu = 0, yv = 0, area = 0;
+	for (int j = 0; j < TILE_SAMPLES; ++j)
+	{
+		for (int i = 0; i < TILE_SAMPLES; ++i)
+		{
+			double u = (dsize.width - 1) * i / (TILE_SAMPLES - 1.), v = (dsize.height - 1) * j / (TILE_SAMPLES - 1.);
+			double W = m[6] * u + m[7] * v + m[8];
+			if (W == 0)
+			{
+				continue;
+			}
+			double X = (m[0] * u + m[1] * v + m[2]) / W, Y = (m[3] * u + m[4] * v + m[5]) / W;
+			if (X < 0 || Y < 0 || X >= ssize.width || Y >= ssize.height)
+			{
+				continue;
+			}
+			double Xu = (m[0] - X * m[6]) / W, Xv = (m[1] - X * m[7]) / W;
+			double Yu = (m[3] - Y * m[6]) / W, Yv = (m[4] - Y * m[7]) / W;
+			xu = std::max(xu, std::abs(Xu));
+			xv = std::max(xv, std::abs(Xv));
+			yu = std::max(yu, std::abs(Yu));
+			yv = std::max(yv, std::abs(Yv));
+			area = std::max(area, std::abs(Xu * Yv - Xv * Yu));
+		}
+	}
+
+	// a width x rows tile maps into a parallelogram over yu * width + yv * rows
+	// source rows, plus the bilinear footprint; each of them is touched over
+	// its share of the parallelogram's area, rounded out to cache lines
+	int width = std::min(BLOCK_SIZE, dsize.width);
+	int rows = dsize.height;
+	for (; rows > TILE_MIN_ROWS; --rows)
+	{
+		double srcRows = yu * width + yv * rows + 2;
+		double span = std::min(area * width * rows / srcRows, xu * width + xv * rows) + 2;
+		double bytes = srcRows * (std::ceil(span * pixelBytes / CACHE_LINE) + 1) * CACHE_LINE;
+		if (bytes <= cacheBytes)
+		{
+			break;
+		}
+	}
+	return Size(width, rows);
+}
+
+// Checks params and fills in the parts of job they decide
+static void InitWarpJob(WarpJob& job, const WarpParams& params)
+{
+	int interpolation = params.interpolation & ~WARP_INVERSE_MAP;
+	CV_Assert(interpolation == INTER_NEAREST || interpolation == INTER_LINEAR ||
+		interpolation == INTER_CUBIC || interpolation == INTER_LANCZOS4);
+	CV_Assert(params.mapMode >= WARP_MAP_SCALAR && params.mapMode <= WARP_MAP_INCREMENTAL);
+	CV_Assert(params.reanchorStep > 0 && params.stripeRows > 0 && (!params.tiled || params.tileCacheBytes > 0));
+
+	job.nearest = interpolation == INTER_NEAREST;
+	job.taps = job.nearest ? 1 : interpolation == INTER_CUBIC ? 4 : interpolation == INTER_LANCZOS4 ? 8 : 2;
+	job.fixedPoint = params.fixedPoint;
+	job.borderMode = params.borderMode & ~BORDER_ISOLATED;
+	for (int c = 0; c < 4; ++c)
+	{
+		job.cval[c] = saturate_cast<uchar>(params.borderValue[c]);
+	}
+
+	job.ctx.bits = job.nearest ? 0 : INTER_BITS;
+	job.ctx.reanchorStep = params.reanchorStep;
+
+	MapRowFunc mapRowTab[] = { MapRowScalar, MapRowSIMD, MapRowIncremental };
+	job.mapRow = mapRowTab[params.mapMode];
+}
+
+// Runs body over stripes [0, stripes) on the threads params asks for. A
+// thread count is met by handing parallel_for_ that many chunks of stripes,
+// never through cv::setNumThreads: that is process wide, and other warps,
+// the video pipeline or the caller may be using OpenCV's pool meanwhile.
+static void RunStripes(const ParallelLoopBody& body, int stripes, const WarpParams& params)
+{
+	if (params.numThreads == 1)
+	{
+		body(Range(0, stripes));
+		return;
+	}
+
+	int chunks = params.numThreads > 0 ? std::min(params.numThreads, stripes) : stripes;
+	parallel_for_(Range(0, stripes), body, chunks);
+}
+
+// Runs job on the threads params asks for
+static void RunWarpJob(const WarpJob& job, const WarpParams& params)
+{
+	// one thread needs no lock, and cv::Mutex allocates its implementation:
+	// WarpImg on caller buffers promises no allocation on one thread
+	int tiles = job.tile.area() > 0 ? ((job.dsize.width + job.tile.width - 1) / job.tile.width) *
+		((job.dsize.height + job.tile.height - 1) / job.tile.height) : 0;
+	if (params.numThreads == 1)
+	{
+		if (tiles)
+		{
+			TileInvoker(job, params.stats, 0)(Range(0, tiles));
+		}
+		else
+		{
+			WarpRows(job, 0, job.dsize.height, 0, job.dsize.width, params.stats);
+		}
+		return;
+	}
+
+	Mutex statsLock;
+	if (tiles)
+	{
+		RunStripes(TileInvoker(job, params.stats, &statsLock), tiles, params);
+		return;
+	}
+
+	int stripes = (job.dsize.height + params.stripeRows - 1) / params.stripeRows;
+	RunStripes(WarpInvoker(job, params.stripeRows, params.stats, &statsLock), stripes, params);
+}
+
+void WarpImg(const Mat& src, Mat& dest, InputArray M, const WarpParams& params)
+{
+	CV_Assert(!src.empty() && src.depth() == CV_8U && src.channels() <= 4);
+	CV_Assert(!dest.empty() && dest.data != src.data);
+	dest.create(dest.size(), src.type());
+
+	WarpJob job;
+	InitWarpJob(job, params);
+	LoadInverseMap(M, params.interpolation, job.ctx.m);
+	job.src = &src;
+	job.dest = &dest;
+	job.dsize = dest.size();
+	if (params.cull && (job.borderMode == BORDER_CONSTANT || job.borderMode == BORDER_TRANSPARENT))
+	{
+		InitCulling(job);
+	}
+	if (params.tiled)
+	{
+		job.tile = ChooseTile(job.ctx, job.dsize, src.size(), (int)src.elemSize(), params.tileCacheBytes);
+	}
+
+	RunWarpJob(job, params);
+}
+
+WarpBuffer::WarpBuffer()
+	: data(0), step(0), type(CV_8UC3)
+{
+}
+
+WarpBuffer::WarpBuffer(void* data, Size size, int type, size_t step)
+	: data(data), size(size), step(step), type(type)
+{
+}
+
+// Asserts buffer holds pixels WarpImg can read or write, see WarpImg
+static void CheckWarpBuffer(const WarpBuffer& buffer)
+{
+	CV_Assert(buffer.data && buffer.size.width > 0 && buffer.size.height > 0);
+	CV_Assert(CV_MAT_DEPTH(buffer.type) == CV_8U && CV_MAT_CN(buffer.type) <= 4);
+	CV_Assert(buffer.step >= (size_t)buffer.size.width * CV_ELEM_SIZE(buffer.type));
+}
+
+bool WarpBufferAligned(const WarpBuffer& buffer, size_t alignment)
+{
+	CV_Assert(alignment > 0);
+	return (size_t)buffer.data % alignment == 0 && buffer.step % alignment == 0;
+}
+
+// Bytes from the first pixel of buffer to past its last
+static size_t BufferBytes(const WarpBuffer& buffer)
+{
+	return buffer.step * (buffer.size.height - 1) + (size_t)buffer.size.width * CV_ELEM_SIZE(buffer.type);
+}
+
+void WarpImg(const WarpBuffer& src, const WarpBuffer& dest, InputArray M, const WarpParams& params)
+{
+	CheckWarpBuffer(src);
+	CheckWarpBuffer(dest);
+	CV_Assert(src.type == dest.type);
+	const uchar* srcStart = (const uchar*)src.data;
+	const uchar* destStart = (const uchar*)dest.data;
+	CV_Assert(destStart + BufferBytes(dest) <= srcStart || srcStart + BufferBytes(src) <= destStart);
+
+	// headers on the caller's memory, no allocation: dest keeps its data as
+	// WarpImg only creates it when the size or type differ
+	Mat srcMat(src.size, src.type, src.data, src.step);
+	Mat destMat(dest.size, dest.type, dest.data, dest.step);
+	WarpImg(srcMat, destMat, M, params);
+	CV_DbgAssert(destMat.data == destStart);
+}
+
+void WarpBatch(const std::vector<Mat>& srcs, std::vector<Mat>& dests, InputArray M, Size dsize, const WarpParams& params)
+{
+	CV_Assert(!srcs.empty() && dsize.width > 0 && dsize.height > 0);
+	const Mat& src0 = srcs[0];
+	CV_Assert(!src0.empty() && src0.depth() == CV_8U && src0.channels() <= 4);
+
+	dests.resize(srcs.size());
+	for (size_t f = 0; f < srcs.size(); ++f)
+	{
+		CV_Assert(srcs[f].size() == src0.size() && srcs[f].type() == src0.type());
+		dests[f].create(dsize, src0.type());
+		for (size_t g = 0; g < srcs.size(); ++g)
+		{
+			CV_Assert(dests[f].data != srcs[g].data);
+		}
+	}
+
+	WarpJob job;
+	InitWarpJob(job, params);
+	LoadInverseMap(M, params.interpolation, job.ctx.m);
+	job.src = &srcs[0];
+	job.dest = &dests[0];
+	job.frames = (int)srcs.size();
+	job.dsize = dsize;
+	if (params.cull && (job.borderMode == BORDER_CONSTANT || job.borderMode == BORDER_TRANSPARENT))
+	{
+		InitCulling(job);
+	}
+	if (params.tiled)
+	{
+		// every frame's footprint has to stay in cache
+		job.tile = ChooseTile(job.ctx, dsize, src0.size(), (int)src0.elemSize() * job.frames, params.tileCacheBytes);
+	}
+
+	RunWarpJob(job, params);
+}
+
+// Rows [y0, y1) of a WarpMosaic destination, owned by the region with that
+// index or, for region -1, the pixels of those rows outside every rect
+struct MosaicTile
+{
+	int region;
+	int y0; // relative to the rect of the region, to dest for region -1
+	int y1;
+};
+
+// Sets the pixels of dest rows [y0, y1) outside every rect to cval, rects
+// sorted by x
+static void FillOutsideRects(Mat& dest, const std::vector<Rect>& rects, int y0, int y1, const uchar* cval)
+{
+	const int cn = dest.channels();
+
+	for (int y = y0; y < y1; ++y)
+	{
+		uchar* D = dest.ptr<uchar>(y);
+		int x = 0;
+		for (size_t i = 0; i < rects.size(); ++i)
+		{
+			const Rect& r = rects[i];
+			if (y < r.y || y >= r.y + r.height)
+			{
+				continue;
+			}
+			FillBorder(D + x * cn, r.x - x, cn, cval);
+			x = r.x + r.width;
+		}
+		FillBorder(D + x * cn, dest.cols - x, cn, cval);
+	}
+}
+
+// Runs the tiles of a WarpMosaic, each with the job of its region
+class MosaicInvoker : public ParallelLoopBody
+{
+public:
+	MosaicInvoker(const std::vector<WarpJob>& jobs, const std::vector<MosaicTile>& tiles, Mat& dest,
+		const std::vector<Rect>& sortedRects, const uchar* cval, WarpStats* stats, Mutex* statsLock)
+		: jobs(jobs), tiles(tiles), dest(dest), sortedRects(sortedRects), cval(cval), stats(stats), statsLock(statsLock)
+	{
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		WarpStats local;
+		for (int t = range.start; t < range.end; ++t)
+		{
+			const MosaicTile& tile = tiles[t];
+			if (tile.region < 0)
+			{
+				FillOutsideRects(dest, sortedRects, tile.y0, tile.y1, cval);
+			}
+			else
+			{
+				const WarpJob& job = jobs[tile.region];
+				WarpRows(job, tile.y0, tile.y1, 0, job.dsize.width, stats ? &local : 0);
+			}
+		}
+
+		if (stats)
+		{
+			AddStats(*stats, local, statsLock);
+		}
+	}
+
+private:
+	const std::vector<WarpJob>& jobs;
+	const std::vector<MosaicTile>& tiles;
+	Mat& dest;
+	const std::vector<Rect>& sortedRects;
+	const uchar* cval;
+	WarpStats* stats;
+	Mutex* statsLock;
+};
+
+static bool RectLeftOf(const Rect& a, const Rect& b)
+{
+	return a.x < b.x;
+}
+
+void WarpMosaic(const Mat& src, Mat& dest, const std::vector<MosaicRegion>& regions, const WarpParams& params)
+{
+	CV_Assert(!src.empty() && src.depth() == CV_8U && src.channels() <= 4);
+	CV_Assert(!dest.empty() && dest.data != src.data && params.stripeRows > 0);
+	dest.create(dest.size(), src.type());
+
+	const int count = (int)regions.size();
+	const Rect bounds(0, 0, dest.cols, dest.rows);
+	std::vector<Rect> sortedRects(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const Rect& r = regions[i].rect;
+		CV_Assert(r.width > 1 && r.height > 1 && (r & bounds) == r);
+		for (int j = 0; j < i; ++j)
+		{
+			CV_Assert((r & regions[j].rect).area() == 0);
+		}
+		sortedRects[i] = r;
+	}
+	std::sort(sortedRects.begin(), sortedRects.end(), RectLeftOf);
+
+	// one job per region, on its rect of dest; the regions' views of dest
+	// must not move once the jobs point at them
+	WarpParams regionParams = params;
+	regionParams.interpolation &= ~WARP_INVERSE_MAP;
+	std::vector<Mat> views(count);
+	std::vector<WarpJob> jobs(count);
+	std::vector<MosaicTile> tiles;
+	for (int i = 0; i < count; ++i)
+	{
+		const MosaicRegion& region = regions[i];
+		WarpJob& job = jobs[i];
+		InitWarpJob(job, regionParams);
+
+		// rect pixels -> unit square -> quad
+		Matx33d H;
+		bool convex = SquareToQuad(region.quad, H);
+		CV_Assert(convex);
+		H = H * Matx33d(1. / (region.rect.width - 1), 0, 0, 0, 1. / (region.rect.height - 1), 0, 0, 0, 1);
+		memcpy(job.ctx.m, H.val, sizeof(job.ctx.m));
+
+		views[i] = dest(region.rect);
+		job.src = &src;
+		job.dest = &views[i];
+		job.dsize = region.rect.size();
+		if (params.cull && (job.borderMode == BORDER_CONSTANT || job.borderMode == BORDER_TRANSPARENT))
+		{
+			InitCulling(job);
+		}
+
+		for (int y = 0; y < job.dsize.height; y += params.stripeRows)
+		{
+			MosaicTile tile = { i, y, std::min(y + params.stripeRows, job.dsize.height) };
+			tiles.push_back(tile);
+		}
+	}
+
+	// the rest of dest only with BORDER_CONSTANT, no region owns it
+	uchar cval[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		cval[c] = saturate_cast<uchar>(params.borderValue[c]);
+	}
+	if ((params.borderMode & ~BORDER_ISOLATED) == BORDER_CONSTANT)
+	{
+		for (int y = 0; y < dest.rows; y += params.stripeRows)
+		{
+			MosaicTile tile = { -1, y, std::min(y + params.stripeRows, dest.rows) };
+			tiles.push_back(tile);
+		}
+	}
+
+	Mutex statsLock;
+	RunStripes(MosaicInvoker(jobs, tiles, dest, sortedRects, cval, params.stats, &statsLock), (int)tiles.size(), params);
+}
+
+// Bilinear sample of img at (x, y) into out[0..cn), after border
+// extrapolation; borderMode is not BORDER_TRANSPARENT
+static inline void SampleLinear(const Mat& img, float x, float y, int borderMode, const uchar* cval, float* out)
+{
+	const int cn = img.channels();
+	int x0 = cvFloor(x), y0 = cvFloor(y);
+	float ax = x - x0, ay = y - y0;
+	const uchar *S00, *S01, *S10, *S11;
+
+	if ((unsigned)x0 < (unsigned)(img.cols - 1) && (unsigned)y0 < (unsigned)(img.rows - 1))
+	{
+		S00 = img.ptr(y0) + x0 * cn;
+		S01 = S00 + cn;
+		S10 = S00 + img.step;
+		S11 = S10 + cn;
+	}
+	else
+	{
+		S00 = SrcPixel(img, x0, y0, borderMode);
+		S01 = SrcPixel(img, x0 + 1, y0, borderMode);
+		S10 = SrcPixel(img, x0, y0 + 1, borderMode);
+		S11 = SrcPixel(img, x0 + 1, y0 + 1, borderMode);
+		S00 = S00 ? S00 : cval;
+		S01 = S01 ? S01 : cval;
+		S10 = S10 ? S10 : cval;
+		S11 = S11 ? S11 : cval;
+	}
+
+	for (int c = 0; c < cn; ++c)
+	{
+		float top = S00[c] + (S01[c] - S00[c]) * ax;
+		float bottom = S10[c] + (S11[c] - S10[c]) * ax;
+		out[c] = top + (bottom - top) * ay;
+	}
+}
+
+// What the stripes of a WarpPyramid share, read only
+struct PyramidJob
+{
+	const std::vector<Mat>* pyramid;
+	Mat* dest;
+	double m[9];     // destination -> level 0 source, W > 0 on the side of the horizon the source is on
+	int borderMode;
+	uchar cval[4];
+};
+
+// Warps destination rows [y0, y1) of a WarpPyramid
+static void WarpPyramidRows(const PyramidJob& job, int y0, int y1, WarpStats* stats)
+{
+	const std::vector<Mat>& pyramid = *job.pyramid;
+	const int levels = (int)pyramid.size();
+	const int cn = job.dest->channels();
+	const int width = job.dest->cols;
+	const double* m = job.m;
+	const Mat& src0 = pyramid[0];
+	// BORDER_TRANSPARENT decides on the level 0 footprint whether a pixel is
+	// written, the samples themselves then replicate the border
+	const int border = job.borderMode == BORDER_TRANSPARENT ? BORDER_REPLICATE : job.borderMode;
+	// as far as the short maps of WarpImg reach; anything further is border
+	// anyway, and the float and int conversions below stay defined
+	const double maxCoord = SHRT_MAX;
+	int64 t0 = stats ? getCPUTickCount() : 0;
+
+	for (int y = y0; y < y1; ++y)
+	{
+		uchar* D = job.dest->ptr<uchar>(y);
+		for (int x = 0; x < width; ++x, D += cn)
+		{
+			double W = m[6] * x + m[7] * y + m[8];
+			if (W <= 0)
+			{
+				// on or behind the horizon, nothing of the source lands here
+				if (job.borderMode != BORDER_TRANSPARENT)
+				{
+					for (int c = 0; c < cn; ++c)
+					{
+						D[c] = job.cval[c];
+					}
+				}
+				continue;
+			}
+			W = 1. / W;
+			double X = std::max(-maxCoord, std::min(maxCoord, (m[0] * x + m[1] * y + m[2]) * W));
+			double Y = std::max(-maxCoord, std::min(maxCoord, (m[3] * x + m[4] * y + m[5]) * W));
+
+			// footprint of the pixel: the source steps along x and y of the
+			// destination, the longer one decides the level
+			double Xu = (m[0] - X * m[6]) * W, Yu = (m[3] - Y * m[6]) * W;
+			double Xv = (m[1] - X * m[7]) * W, Yv = (m[4] - Y * m[7]) * W;
+			double footprint = std::max(Xu * Xu + Yu * Yu, Xv * Xv + Yv * Yv);
+			float lod = footprint > 1 ? (float)(0.5 / CV_LOG2 * std::log(footprint)) : 0.f;
+			lod = std::min(lod, (float)(levels - 1));
+			int level = (int)lod;
+			float t = lod - level;
+
+			if (job.borderMode == BORDER_TRANSPARENT && !((unsigned)cvFloor(X) < (unsigned)(src0.cols - 1) &&
+				(unsigned)cvFloor(Y) < (unsigned)(src0.rows - 1)))
+			{
+				continue;
+			}
+
+			float s0[4], s1[4];
+			float scale = 1.f / (1 << level);
+			SampleLinear(pyramid[level], (float)X * scale, (float)Y * scale, border, job.cval, s0);
+			if (t > 0)
+			{
+				SampleLinear(pyramid[level + 1], (float)X * scale * 0.5f, (float)Y * scale * 0.5f, border, job.cval, s1);
+				for (int c = 0; c < cn; ++c)
+				{
+					s0[c] += (s1[c] - s0[c]) * t;
+				}
+			}
+			for (int c = 0; c < cn; ++c)
+			{
+				D[c] = saturate_cast<uchar>(s0[c]);
+			}
+		}
+	}
+
+	if (stats)
+	{
+		stats->gatherTicks += getCPUTickCount() - t0;
+		stats->rows += y1 - y0;
+		stats->pixels += (int64)(y1 - y0) * width;
+		stats->covered += (int64)(y1 - y0) * width;
+	}
+}
+
+// Runs stripes of stripeRows rows of a WarpPyramid
+class PyramidInvoker : public ParallelLoopBody
+{
+public:
+	PyramidInvoker(const PyramidJob& job, int stripeRows, WarpStats* stats, Mutex* statsLock)
+		: job(job), stripeRows(stripeRows), stats(stats), statsLock(statsLock)
+	{
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		int y0 = range.start * stripeRows;
+		int y1 = std::min(range.end * stripeRows, job.dest->rows);
+		WarpStats local;
+		WarpPyramidRows(job, y0, y1, stats ? &local : 0);
+		if (stats)
+		{
+			AddStats(*stats, local, statsLock);
+		}
+	}
+
+private:
+	const PyramidJob& job;
+	int stripeRows;
+	WarpStats* stats;
+	Mutex* statsLock;
+};
+
+void WarpPyramid(const std::vector<Mat>& pyramid, Mat& dest, InputArray M, const WarpParams& params)
+{
+	CV_Assert(!pyramid.empty() && !dest.empty() && params.stripeRows > 0);
+	CV_Assert((params.interpolation & ~WARP_INVERSE_MAP) == INTER_LINEAR);
+	const Mat& src = pyramid[0];
+	CV_Assert(!src.empty() && src.depth() == CV_8U && src.channels() <= 4);
+	for (size_t l = 0; l < pyramid.size(); ++l)
+	{
+		CV_Assert(pyramid[l].type() == src.type() && pyramid[l].data != dest.data);
+	}
+	dest.create(dest.size(), src.type());
+
+	PyramidJob job;
+	job.pyramid = &pyramid;
+	job.dest = &dest;
+	LoadInverseMap(M, params.interpolation, job.m);
+	job.borderMode = params.borderMode & ~BORDER_ISOLATED;
+	for (int c = 0; c < 4; ++c)
+	{
+		job.cval[c] = saturate_cast<uchar>(params.borderValue[c]);
+	}
+
+	// M and -M are the same homography; pick the sign that gives the
+	// destination image of the source center W > 0, which is 1 / w of that
+	// center mapped forward
+	double fwd[9];
+	InvertMat33(job.m, fwd);
+	if (fwd[6] * src.cols * 0.5 + fwd[7] * src.rows * 0.5 + fwd[8] < 0)
+	{
+		for (int i = 0; i < 9; ++i)
+		{
+			job.m[i] = -job.m[i];
+		}
+	}
+
+	Mutex statsLock;
+	int stripes = (dest.rows + params.stripeRows - 1) / params.stripeRows;
+	RunStripes(PyramidInvoker(job, params.stripeRows, params.stats, &statsLock), stripes, params);
+}
+
+Size ChooseWarpTile(const Mat& src, Size dsize, InputArray M, const WarpParams& params)
+{
+	CV_Assert(!src.empty() && dsize.width > 0 && dsize.height > 0 && params.tileCacheBytes > 0);
+
+	MapContext ctx;
+	LoadInverseMap(M, params.interpolation, ctx.m);
+	return ChooseTile(ctx, dsize, src.size(), (int)src.elemSize(), params.tileCacheBytes);
+}
+
+void BuildWarpMaps(Size dsize, InputArray M, const WarpParams& params, Mat& xy, Mat& frac)
+{
+	CV_Assert(dsize.width > 0 && dsize.height > 0);
+
+	WarpJob job;
+	InitWarpJob(job, params);
+	LoadInverseMap(M, params.interpolation, job.ctx.m);
+
+	xy.create(dsize, CV_16SC2);
+	if (job.nearest)
+	{
+		frac.release();
+	}
+	else
+	{
+		frac.create(dsize, CV_16UC1);
+	}
+	job.xyOut = &xy;
+	job.fracOut = &frac;
+	job.dsize = dsize;
+
+	RunWarpJob(job, params);
+}
+
+void ShiftWarpMaps(Mat& xy, Mat& frac, Point shift)
+{
+	CV_Assert(xy.type() == CV_16SC2);
+	const bool nearest = frac.empty();
+	CV_Assert(nearest || (frac.type() == CV_16UC1 && frac.size() == xy.size()));
+	const int mask = INTER_TAB_SIZE - 1;
+
+	for (int y = 0; y < xy.rows; ++y)
+	{
+		short* XY = xy.ptr<short>(y);
+		ushort* A = nearest ? 0 : frac.ptr<ushort>(y);
+
+		for (int x = 0; x < xy.cols; ++x)
+		{
+			if (nearest)
+			{
+				XY[x * 2] = saturate_cast<short>(XY[x * 2] + shift.x);
+				XY[x * 2 + 1] = saturate_cast<short>(XY[x * 2 + 1] + shift.y);
+				continue;
+			}
+
+			// back to one fixed point coordinate, shift, split again
+			int X = XY[x * 2] * INTER_TAB_SIZE + (A[x] & mask) + shift.x;
+			int Y = XY[x * 2 + 1] * INTER_TAB_SIZE + (A[x] >> INTER_BITS) + shift.y;
+			XY[x * 2] = saturate_cast<short>(X >> INTER_BITS);
+			XY[x * 2 + 1] = saturate_cast<short>(Y >> INTER_BITS);
+			A[x] = (ushort)(((Y & mask) << INTER_BITS) + (X & mask));
+		}
+	}
+}
+
+void RemapImg(const Mat& src, Mat& dest, const Mat& xy, const Mat& frac, const WarpParams& params)
+{
+	CV_Assert(!src.empty() && src.depth() == CV_8U && src.channels() <= 4);
+	CV_Assert(xy.type() == CV_16SC2 && !xy.empty());
+
+	WarpJob job;
+	InitWarpJob(job, params);
+	CV_Assert(job.nearest || (frac.type() == CV_16UC1 && frac.size() == xy.size()));
+
+	dest.create(xy.size(), src.type());
+	CV_Assert(dest.data != src.data);
+	job.src = &src;
+	job.dest = &dest;
+	job.xyMap = &xy;
+	job.fracMap = &frac;
+	job.dsize = xy.size();
+
+	RunWarpJob(job, params);
+}
@@ -0,0 +1,179 @@
+#ifndef WARP_ENGINE_H
+#define WARP_ENGINE_H
+
+#include <vector>                          // std::vector
+#include <opencv2/core/core.hpp>           // cv::Mat
+#include <opencv2/imgproc/imgproc.hpp>     // cv::INTER_*, cv::WARP_INVERSE_MAP
+
+// How the source coordinate of each destination pixel is evaluated
+enum WarpMapMode
+{
+	WARP_MAP_SCALAR = 0,     // double precision 3x3 product per pixel
+	WARP_MAP_SIMD = 1,       // v_float32x4 row kernel, 8 pixels per iteration
+	WARP_MAP_INCREMENTAL = 2 // forward differencing along the row, one add per term per pixel
+};
+
+// Timings collected by WarpImg when WarpParams::stats is set.
+// Ticks are cv::getCPUTickCount() units, i.e. cycles on x86.
+struct WarpStats
+{
+	int64 rows;        // destination rows processed, summed over the frames of a batch
+	int64 mapTicks;    // spent computing source coordinates
+	int64 gatherTicks; // spent fetching and interpolating source pixels
+	int64 pixels;      // destination pixels processed
+	int64 covered;     // of those, mapped and interpolated; the rest got the border by culling
+
+	WarpStats();
+
+	// Share of the destination that needed interpolation
+	double CoveredRatio() const { return pixels ? (double)covered / pixels : 0.; }
+};
+
+// Settings of one warp call
+struct WarpParams
+{
+	int interpolation;       // INTER_NEAREST, INTER_LINEAR, INTER_CUBIC or INTER_LANCZOS4, may be or'ed with WARP_INVERSE_MAP
+	int borderMode;          // BORDER_CONSTANT, BORDER_REPLICATE, BORDER_TRANSPARENT, ...
+	cv::Scalar borderValue;  // used with BORDER_CONSTANT
+	int mapMode;             // one of WarpMapMode
+	int reanchorStep;        // WARP_MAP_INCREMENTAL: pixels between exact evaluations, bounds float drift
+	bool fixedPoint;         // INTER_LINEAR: 16-bit integer blend, bit-exact with remap on CV_16SC2 maps
+	int numThreads;          // 1 runs on the calling thread, > 1 splits the call into that many parallel_for_ chunks, 0 one chunk per stripe; OpenCV's pool size bounds both
+	int stripeRows;          // destination rows per parallel_for_ stripe
+	bool cull;               // BORDER_CONSTANT/TRANSPARENT: only visit pixels inside the projected source quad
+	bool tiled;              // WarpImg, WarpBatch: walk the destination in tiles from ChooseWarpTile, for large sources
+	int tileCacheBytes;      // tiled: source bytes a tile may touch, about the L2 cache of a core
+	WarpStats* stats;        // accumulates timings when not null, ticks are summed over threads
+
+	WarpParams();
+};
+
+// Perspective warp by inverse mapping: every destination pixel is mapped back
+// into the source and sampled there, so the output has no holes.
+// M is the 3x3 source -> destination homography, just like warpPerspective,
+// unless WARP_INVERSE_MAP is set in which case it maps destination -> source.
+// dest keeps its size (that is the output size) and gets the type of src.
+// Supports 8-bit images with 1 to 4 channels.
+//
+// Each destination row is processed in blocks: the map stage computes fixed
+// point source coordinates (INTER_BITS fractional bits, the same layout
+// warpPerspective hands to remap) and the gather stage interpolates from them.
+// INTER_CUBIC and INTER_LANCZOS4 take their separable weights from tables
+// quantized per map fraction, the horizontal taps in 16-bit fixed point; they
+// are within a level or two of warpPerspective.
+// Rows are split into stripes run by cv::parallel_for_; the output is the same
+// for any thread count and stripe size.
+// With params.cull the source rectangle is projected into the destination and
+// scan-converted, each row is mapped and gathered only over its covered span
+// and the rest of the row gets the border value in one fill.
+// With params.tiled the destination is walked tile by tile instead of row by
+// row, and the source footprint of each tile is prefetched before it is
+// interpolated. Rows of a rotated or minified source stride over many source
+// rows, which for an 8K source or a panorama no longer stay in cache from one
+// destination row to the next; a tile's footprint does. The output is the
+// same as without tiles.
+void WarpImg(const cv::Mat& src, cv::Mat& dest, cv::InputArray M, const WarpParams& params = WarpParams());
+
+// An image in memory the caller owns, a decoder's output or a ShmRingWriter
+// slot: data points at the top left pixel, rows are step bytes apart. The
+// bytes past the last pixel of a row are padding a warp never touches.
+struct WarpBuffer
+{
+	void* data;
+	cv::Size size;
+	size_t step;   // bytes from one row to the next, at least size.width pixels
+	int type;      // CV_8UC1 to CV_8UC4
+
+	WarpBuffer();
+	WarpBuffer(void* data, cv::Size size, int type, size_t step);
+};
+
+// Whether every row of buffer starts on an alignment byte boundary, data and
+// step both multiples of it. WarpImg does not need it, but a caller picking a
+// step can keep the rows on the 16-byte boundary of the SSE/NEON registers.
+bool WarpBufferAligned(const WarpBuffer& buffer, size_t alignment = 16);
+
+// WarpImg from src into dest, both caller memory. The buffers are validated
+// first and CV_Assert fails when either has no pixels, is not 8-bit with 1
+// to 4 channels, has a step shorter than a row, when the types differ or the
+// buffers overlap. Rows may start at any byte: the kernels read and write
+// them with unaligned loads and stores, see WarpBufferAligned.
+// Every output pixel is written straight into dest.data at dest.step: no
+// intermediate image, no copy, and the row padding is left as it is. With
+// params.numThreads 1 the call makes no heap allocation at all (warp_bench
+// --check counts them); more threads go through cv::parallel_for_, whose
+// backend may allocate.
+void WarpImg(const WarpBuffer& src, const WarpBuffer& dest, cv::InputArray M, const WarpParams& params = WarpParams());
+
+// WarpImg over a burst of frames from the same camera: all of srcs must have
+// the same size and type, dests gets one dsize output per frame. Each map
+// block is computed once and gathered into every frame while it is still in
+// L1, so the map stage costs the same for 1 or 64 frames. Output is the same
+// as calling WarpImg on each frame.
+void WarpBatch(const std::vector<cv::Mat>& srcs, std::vector<cv::Mat>& dests, cv::InputArray M, cv::Size dsize,
+	const WarpParams& params = WarpParams());
+
+// One planar region of a WarpMosaic: the source quad, corners in the
+// gDistortPts order, is rectified into rect of the destination with quad[0]
+// at its top left corner and quad[1] at its top right corner
+struct MosaicRegion
+{
+	cv::Point2f quad[4];
+	cv::Rect rect;
+
+	MosaicRegion();
+	MosaicRegion(const cv::Point2f quad[4], cv::Rect rect);
+};
+
+// Rectifies several regions of src into one composite dest in a single pass,
+// instead of one WarpImg or warpPerspective per region over the whole output.
+// The rects must lie inside dest (which keeps its size) and not overlap; the
+// quads must be convex. WARP_INVERSE_MAP in params.interpolation is ignored.
+//
+// dest is cut into tiles of params.stripeRows rows of one rect each, which
+// carry the homography of their region, plus a tile per stripe for the pixels
+// outside every rect; all tiles go through one cv::parallel_for_, so every
+// output pixel is computed exactly once and regions run in parallel. A rect
+// gets the same pixels as WarpImg into dest(rect) would give it. Pixels
+// outside every rect get params.borderValue with BORDER_CONSTANT and are left
+// as they are otherwise.
+void WarpMosaic(const cv::Mat& src, cv::Mat& dest, const std::vector<MosaicRegion>& regions,
+	const WarpParams& params = WarpParams());
+
+// Anti-aliased WarpImg for strongly minified regions, where one bilinear
+// sample per pixel aliases. pyramid is the source as cv::buildPyramid gives
+// it, built once per frame: level l is the source downscaled by 2^l. Every
+// destination pixel picks its level from the Jacobian of the destination ->
+// source map, log2 of the longer axis of its footprint, and blends bilinear
+// samples of the two nearest levels (trilinear); magnified pixels sample
+// level 0 only. params.interpolation must be INTER_LINEAR, or'ed with
+// WARP_INVERSE_MAP as usual; the map and gather settings are ignored. With
+// BORDER_TRANSPARENT a pixel is left as it is when its level 0 footprint is
+// not inside the source, coarser levels replicate their border. Pixels on or
+// beyond the horizon of M get the border value in every other mode.
+void WarpPyramid(const std::vector<cv::Mat>& pyramid, cv::Mat& dest, cv::InputArray M, const WarpParams& params = WarpParams());
+
+// Destination tile WarpImg walks with params.tiled: one map block (256
+// columns) wide, or the whole width when narrower, and as many rows as keep
+// the source cache lines the tile touches within params.tileCacheBytes. The
+// footprint is estimated from the largest Jacobian of the destination ->
+// source map over the part of the destination that samples src.
+cv::Size ChooseWarpTile(const cv::Mat& src, cv::Size dsize, cv::InputArray M, const WarpParams& params = WarpParams());
+
+// Runs only the map stage of WarpImg over a dsize destination.
+// xy gets the CV_16SC2 integer source coordinates and frac the CV_16UC1
+// sub-pixel index (released for INTER_NEAREST), the layout remap takes.
+void BuildWarpMaps(cv::Size dsize, cv::InputArray M, const WarpParams& params, cv::Mat& xy, cv::Mat& frac);
+
+// Moves every source coordinate of maps from BuildWarpMaps by shift, given in
+// 1/INTER_TAB_SIZE pixels, or in whole pixels for INTER_NEAREST maps (frac
+// empty). For a small translation of the source this is far cheaper than
+// building the maps again.
+void ShiftWarpMaps(cv::Mat& xy, cv::Mat& frac, cv::Point shift);
+
+// Runs only the gather stage of WarpImg with maps from BuildWarpMaps.
+// params.interpolation must match the one the maps were built with, the map
+// settings of params are ignored. dest gets the size of the maps.
+void RemapImg(const cv::Mat& src, cv::Mat& dest, const cv::Mat& xy, const cv::Mat& frac, const WarpParams& params = WarpParams());
+
+#endif